@@ -0,0 +1,343 @@
+#include "../scene/scenes.h"
+#include "../render/heatmap.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Benchmark driver: renders the registered scenes without writing an image and reports the
+// setup and render phases separately as JSON on stdout. Progress goes to std::clog. With
+// --heatmap it also writes <scene>_<metric>.png/.pfm showing the cost of every pixel.
+//
+//   bench [--scene name]... [--synthetic] [--width N] [--spp N] [--depth N] [--threads N]
+//         [--texture-cache MB] [--compact-bvh] [--closed-shading] [--generic-integrator] [--caustics photons] [--guide]
+//         [--env image]
+//         [--heatmap time|bvh_nodes|primitive_tests|path_depth] [--list]
+
+using bench_clock = std::chrono::steady_clock;
+
+static double milliseconds(bench_clock::time_point from, bench_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+static long long peak_memory_bytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (long long)counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss; /* macOS以字节为单位 */
+#else
+    return (long long)usage.ru_maxrss * 1024; /* Linux以KB为单位 */
+#endif
+#endif
+}
+
+/* 统计world.hit的调用次数：相机每追踪一条光线恰好调用一次 */
+class ray_counter : public hittable
+{
+public:
+    ray_counter(const hittable &world) : world(world) {}
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        tally().count++;
+        return world.hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return world.bounding_box(); }
+
+    // Rays counted by the calling thread plus every worker thread that has exited. Each thread
+    // counts privately so the render threads never contend on a shared counter.
+    static long long count() { return finished + tally().count; }
+
+private:
+    struct thread_tally
+    {
+        long long count = 0;
+        ~thread_tally() { finished += count; }
+    };
+
+    static thread_tally &tally()
+    {
+        thread_local thread_tally t;
+        return t;
+    }
+
+    const hittable &world;
+    static inline std::atomic<long long> finished{0};
+};
+
+struct bench_options
+{
+    std::vector<std::string> scenes;
+    bool synthetic_only = false;
+    int width = 0; // 0 keeps the scene's own setting
+    int spp = 0;
+    int depth = 0;
+    int threads = 0;
+    int texture_cache_mb = 0; // 0 keeps the default cap
+    bool compact_bvh = false; /* 用compact_bvh代替bvh_node */
+    bool closed_shading = false; /* 用shading_table代替虚函数着色 */
+    bool generic_integrator = false; /* 不按场景特性专门化积分器 */
+    int caustic_photons = 0; /* 焦散光子图的光子数 */
+    bool path_guiding = false; /* 路径引导 */
+    std::string environment_map; /* 代替背景色的环境图 */
+    bool heatmap = false;
+    heatmap_metric metric = heatmap_metric::time;
+    std::string metric_name;
+};
+
+struct bench_result
+{
+    std::string name;
+    int width, height, spp, threads;
+    size_t objects;
+    unsigned features; // scene_feature bits the integrator was specialized for
+    double scene_ms, guide_ms, first_pixel_ms, steady_ms;
+    scene::build_timings build; // scene::build() by phase
+    long long primary_rays, total_rays;
+    long long steady_primary_rays, steady_total_rays; /* 不含单独计时的第一个像素 */
+    long long peak_memory;
+    size_t texture_cache_bytes; /* 渲染结束时驻留的解码原图和纹理tile */
+    double mean;
+};
+
+static void write_heatmap(const scene &s, const std::string &name, const bench_options &options)
+{
+    // A separate, untimed render that records the cost of every pixel.
+    heatmap map;
+    map.render(s.cam, s.world, s.light_sampler(), options.metric);
+
+    auto prefix = name + "_" + options.metric_name;
+    auto top = map.write_png(prefix + ".png");
+    if (top < 0 || !map.write_raw(prefix + ".pfm"))
+        std::cerr << "Could not write " << prefix << ".png/.pfm\n";
+    else
+        std::clog << "\rWrote " << prefix << ".png (full scale " << top << ") and " << prefix << ".pfm\n";
+}
+
+static bench_result run(const scene_entry &entry, const bench_options &options)
+{
+    bench_result result;
+    result.name = entry.name;
+
+    // Random scenes are built from a fresh generator, whichever scenes ran before.
+    seed_random(std::mt19937::default_seed);
+    auto start = bench_clock::now();
+    scene s = entry.make();
+    auto built = bench_clock::now();
+    result.objects = s.world.objects.size();
+
+    s.use_compact_bvh = options.compact_bvh;
+    s.use_closed_shading = options.closed_shading;
+    s.use_feature_integrator = !options.generic_integrator;
+    s.caustic_photons = options.caustic_photons;
+    s.use_path_guiding = options.path_guiding;
+    if (!options.environment_map.empty())
+        s.environment_map = options.environment_map;
+    s.build();
+    result.build = s.build_times;
+
+    if (options.width > 0)
+        s.cam.image_width = options.width;
+    if (options.spp > 0)
+        s.cam.samples_per_pixel = options.spp;
+    if (options.depth > 0)
+        s.cam.max_depth = options.depth;
+    if (options.threads > 0)
+        s.cam.thread_count = options.threads;
+    s.cam.initialize();
+    auto guide_start = bench_clock::now();
+    s.train_guide();
+    result.guide_ms = milliseconds(guide_start, bench_clock::now());
+
+    result.width = s.cam.image_width;
+    result.height = s.cam.height();
+    result.spp = s.cam.samples_taken_per_pixel();
+    result.features = s.cam.features;
+    result.threads = s.cam.thread_count > 0 ? s.cam.thread_count : int(std::thread::hardware_concurrency());
+
+    ray_counter world(s.world);
+    const hittable &lights = s.light_sampler();
+
+    // The first pixel is timed on its own: it pays for cold caches and lazy initialization,
+    // which is what an interactive user waits for. The full tiled render that follows is the
+    // steady state.
+    auto rays_before = ray_counter::count();
+    auto render_start = bench_clock::now();
+    s.cam.render_pixel(0, 0, world, lights);
+    auto first_pixel = bench_clock::now();
+    auto first_pixel_rays = ray_counter::count() - rays_before;
+
+    std::vector<color> pixels;
+    s.cam.render_image(world, lights, pixels);
+    auto done = bench_clock::now();
+    std::clog << "\r" << entry.name << ": done.                        \n";
+
+    result.scene_ms = milliseconds(start, built);
+    result.first_pixel_ms = milliseconds(render_start, first_pixel);
+    result.steady_ms = milliseconds(first_pixel, done);
+    result.steady_primary_rays = (long long)result.width * result.height * result.spp;
+    result.steady_total_rays = ray_counter::count() - rays_before - first_pixel_rays;
+    result.primary_rays = result.steady_primary_rays + result.spp;
+    result.total_rays = result.steady_total_rays + first_pixel_rays;
+    result.peak_memory = peak_memory_bytes();
+    result.texture_cache_bytes = texture_cache::global().resident_bytes();
+
+    if (options.heatmap)
+        write_heatmap(s, entry.name, options);
+
+    // The mean pixel value is a cheap sanity check that two builds rendered the same thing.
+    color sum(0, 0, 0);
+    for (const auto &pixel : pixels)
+        sum += pixel;
+    result.mean = (sum.x() + sum.y() + sum.z()) / (3 * pixels.size());
+    return result;
+}
+
+static void write_json(std::ostream &out, const std::vector<bench_result> &results)
+{
+    out << "{\n  \"scenes\": [\n";
+    for (size_t k = 0; k < results.size(); k++)
+    {
+        const auto &r = results[k];
+        // Rates cover the steady-state phase only; a pixel sample is one primary ray.
+        auto steady_seconds = r.steady_ms / 1000;
+        auto primary_rate = steady_seconds > 0 ? r.steady_primary_rays / steady_seconds : 0.0;
+        auto total_rate = steady_seconds > 0 ? r.steady_total_rays / steady_seconds : 0.0;
+
+        char line[2048];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"spp\": %d, \"threads\": %d, \"objects\": %zu, \"features\": \"0x%02x\",\n"
+                      "     \"scene_build_ms\": %.3f, \"image_decode_ms\": %.3f, \"bvh_build_ms\": %.3f, \"light_set_ms\": %.3f,"
+                      " \"shading_compile_ms\": %.3f, \"photon_map_ms\": %.3f, \"environment_map_ms\": %.3f,\n"
+                      "     \"guide_training_ms\": %.3f, \"first_pixel_ms\": %.3f,"
+                      " \"time_to_first_pixel_ms\": %.3f, \"steady_state_ms\": %.3f,\n"
+                      "     \"primary_rays\": %lld, \"total_rays\": %lld,"
+                      " \"primary_rays_per_sec\": %.1f, \"total_rays_per_sec\": %.1f, \"samples_per_sec\": %.1f,\n"
+                      "     \"peak_memory_bytes\": %lld, \"texture_cache_bytes\": %zu, \"mean_pixel_value\": %.6f}%s\n",
+                      r.name.c_str(), r.width, r.height, r.spp, r.threads, r.objects, r.features,
+                      r.scene_ms, r.build.image_decode, r.build.bvh, r.build.light_set,
+                      r.build.shading, r.build.photon_map, r.build.environment_map,
+                      r.guide_ms, r.first_pixel_ms,
+                      r.scene_ms + r.build.total() + r.first_pixel_ms, r.steady_ms,
+                      r.primary_rays, r.total_rays,
+                      primary_rate, total_rate, primary_rate,
+                      r.peak_memory, r.texture_cache_bytes, r.mean, (k + 1 < results.size()) ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parse_int(const char *text, int &value)
+{
+    char *end;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed <= 0)
+        return false;
+    value = int(parsed);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options options;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--list")
+        {
+            for (const auto &entry : scene_registry())
+                std::cout << entry.name << (entry.synthetic ? " (synthetic)" : "") << '\n';
+            return 0;
+        }
+        else if (arg == "--heatmap" && has_value)
+        {
+            options.metric_name = argv[++a];
+            if (!heatmap::parse(options.metric_name, options.metric) || !heatmap::available(options.metric))
+            {
+                std::cerr << "Unknown or unavailable heatmap metric '" << options.metric_name
+                          << "' (time; bvh_nodes, primitive_tests, path_depth need RT_ENABLE_STATS)\n";
+                return 1;
+            }
+            options.heatmap = true;
+        }
+        else if (arg == "--compact-bvh")
+            options.compact_bvh = true;
+        else if (arg == "--closed-shading")
+            options.closed_shading = true;
+        else if (arg == "--generic-integrator")
+            options.generic_integrator = true;
+        else if (arg == "--guide")
+            options.path_guiding = true;
+        else if (arg == "--synthetic")
+            options.synthetic_only = true;
+        else if (arg == "--scene" && has_value)
+            options.scenes.push_back(argv[++a]);
+        else if (arg == "--env" && has_value)
+            options.environment_map = argv[++a];
+        else if ((arg == "--width" && has_value && parse_int(argv[++a], options.width)) ||
+                 (arg == "--spp" && has_value && parse_int(argv[++a], options.spp)) ||
+                 (arg == "--depth" && has_value && parse_int(argv[++a], options.depth)) ||
+                 (arg == "--threads" && has_value && parse_int(argv[++a], options.threads)) ||
+                 (arg == "--caustics" && has_value && parse_int(argv[++a], options.caustic_photons)) ||
+                 (arg == "--texture-cache" && has_value && parse_int(argv[++a], options.texture_cache_mb)))
+            continue;
+        else
+        {
+            std::cerr << "usage: bench [--scene name]... [--synthetic] [--width N] [--spp N] [--depth N] [--threads N]\n"
+                         "             [--texture-cache MB] [--compact-bvh] [--closed-shading] [--generic-integrator] [--caustics photons] [--guide]\n"
+                         "             [--env image] [--heatmap time|bvh_nodes|primitive_tests|path_depth] [--list]\n";
+            return 1;
+        }
+    }
+
+    if (options.texture_cache_mb > 0)
+        texture_cache::global().set_capacity(size_t(options.texture_cache_mb) << 20);
+
+    std::vector<const scene_entry *> selected;
+    if (options.scenes.empty())
+    {
+        for (const auto &entry : scene_registry())
+            if (!options.synthetic_only || entry.synthetic)
+                selected.push_back(&entry);
+    }
+    for (const auto &name : options.scenes)
+    {
+        auto entry = find_scene(name);
+        if (!entry)
+        {
+            std::cerr << "Unknown scene '" << name << "', see --list\n";
+            return 1;
+        }
+        selected.push_back(entry);
+    }
+
+    std::vector<bench_result> results;
+    for (auto entry : selected)
+        results.push_back(run(*entry, options));
+
+    write_json(std::cout, results);
+}
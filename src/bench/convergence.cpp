@@ -0,0 +1,344 @@
+#include "../scene/scenes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Equal-quality harness: judges integrator and sampling changes by error over time rather than
+// raw speed. Reference images are rendered once at high spp and kept as PFM files; each run then
+// renders the scene progressively and records RMSE and relMSE against the reference after every
+// pass, as a function of wall-clock time and sample count.
+//
+//   convergence --make-reference [--ref-spp N] [scene options]
+//   convergence [--seconds S] [--pass-spp N] [--target-relmse E] [--caustics photons] [--guide] [scene options]
+//
+// --caustics measures renders that take caustics from a photon map; references are always path
+// traced, so the error includes the photon map's blur. --guide measures path guiding, which learns
+// during the first passes of the measured render itself.
+//
+//   scene options: [--scene name]... [--width N] [--ref-dir dir] [--env image]
+//
+// --env lights every scene with an environment map, references included; their files are named
+// after the map as well.
+
+using conv_clock = std::chrono::steady_clock;
+
+static const unsigned int reference_seed = 1u << 24;
+
+/* 线性浮点图像，按行存储RGB */
+struct float_image
+{
+    int width = 0, height = 0;
+    std::vector<float> data;
+
+    float_image() {}
+    float_image(int width, int height) : width(width), height(height), data(size_t(width) * height * 3, 0.0f) {}
+};
+
+static bool write_pfm(const std::string &filename, const float_image &image)
+{
+    // PFM stores scanlines bottom to top; a negative scale means little-endian floats.
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+        return false;
+    out << "PF\n"
+        << image.width << ' ' << image.height << "\n-1.0\n";
+    for (int j = image.height - 1; j >= 0; j--)
+        out.write(reinterpret_cast<const char *>(&image.data[size_t(j) * image.width * 3]), sizeof(float) * image.width * 3);
+    return bool(out);
+}
+
+static bool read_pfm(const std::string &filename, float_image &image)
+{
+    std::ifstream in(filename, std::ios::binary);
+    std::string magic;
+    int width, height;
+    double scale;
+    if (!(in >> magic >> width >> height >> scale) || magic != "PF" || scale >= 0)
+        return false;
+    in.get(); // single whitespace before the raster
+
+    image = float_image(width, height);
+    for (int j = height - 1; j >= 0; j--)
+        in.read(reinterpret_cast<char *>(&image.data[size_t(j) * width * 3]), sizeof(float) * width * 3);
+    return bool(in);
+}
+
+struct conv_options
+{
+    std::vector<std::string> scenes;
+    std::string ref_dir = "reference";
+    int width = 100;
+    int ref_spp = 4096;
+    int pass_spp = 4;
+    double seconds = 10;
+    double target_relmse = 0.01;
+    int caustic_photons = 0;
+    bool path_guiding = false;
+    std::string environment_map;
+    bool make_reference = false;
+};
+
+static std::string reference_path(const conv_options &options, const std::string &name)
+{
+    auto path = options.ref_dir + "/" + name + "_" + std::to_string(options.width);
+    if (!options.environment_map.empty())
+    {
+        // The map's file name without directories or extension.
+        auto stem = options.environment_map.substr(options.environment_map.find_last_of("/\\") + 1);
+        path += "_" + stem.substr(0, stem.find_last_of('.'));
+    }
+    return path + ".pfm";
+}
+
+static scene prepare(const scene_entry &entry, const conv_options &options, bool measured)
+{
+    // Random scenes come out as in a fresh process, whichever scenes were built before, so the
+    // measured scene is the one the --make-reference run rendered.
+    seed_random(std::mt19937::default_seed);
+    scene s = entry.make();
+    if (!options.environment_map.empty())
+        s.environment_map = options.environment_map;
+    if (measured)
+    {
+        s.caustic_photons = options.caustic_photons;
+        s.use_path_guiding = options.path_guiding;
+    }
+    s.build();
+    s.cam.image_width = options.width;
+    return s;
+}
+
+static int accumulate_pass(scene &s, int spp, unsigned int seed, float_image &sum)
+{
+    // One progressive pass of `spp` stratified samples per pixel, added with its sample count as
+    // weight. Every pass needs its own seed, otherwise it would repeat the previous samples.
+    // Returns the number of samples actually taken per pixel.
+    s.cam.samples_per_pixel = spp;
+    s.cam.seed = seed;
+    s.cam.initialize();
+    auto taken = s.cam.samples_taken_per_pixel();
+    auto weight = float(taken);
+
+    std::vector<color> pixels;
+    s.cam.render_image(s.world, s.light_sampler(), pixels);
+    for (size_t k = 0; k < pixels.size(); k++)
+    {
+        sum.data[3 * k + 0] += weight * float(pixels[k].x());
+        sum.data[3 * k + 1] += weight * float(pixels[k].y());
+        sum.data[3 * k + 2] += weight * float(pixels[k].z());
+    }
+    return taken;
+}
+
+static int image_height(scene &s)
+{
+    s.cam.initialize();
+    return s.cam.height();
+}
+
+static int make_reference(const scene_entry &entry, const conv_options &options)
+{
+    scene s = prepare(entry, options, false);
+    float_image sum(options.width, image_height(s));
+
+    // Render in passes so progress is visible; the result is the plain average of all samples.
+    // Reference passes use seeds far from the measured ones so the two never share samples.
+    int done = 0;
+    for (unsigned int pass = 0; done < options.ref_spp; pass++)
+    {
+        done += accumulate_pass(s, std::min(64, options.ref_spp - done), reference_seed + pass, sum);
+        std::clog << "\r" << entry.name << ": reference " << done << '/' << options.ref_spp << " spp   " << std::flush;
+    }
+    for (auto &value : sum.data)
+        value /= done;
+
+    auto path = reference_path(options, entry.name);
+    if (!write_pfm(path, sum))
+    {
+        std::cerr << "\nCould not write '" << path << "'\n";
+        return 1;
+    }
+    std::clog << "\r" << entry.name << ": wrote " << path << "                \n";
+    return 0;
+}
+
+struct error_sample
+{
+    double seconds;
+    int spp;
+    double rmse;
+    double relmse;
+};
+
+static void compare(const float_image &sum, int spp, const float_image &reference, double &rmse, double &relmse)
+{
+    // relMSE divides by the squared reference value (plus a small epsilon for black pixels), so
+    // dark and bright regions count equally.
+    double squared = 0, relative = 0;
+    for (size_t k = 0; k < sum.data.size(); k++)
+    {
+        double estimate = sum.data[k] / spp;
+        double diff = estimate - reference.data[k];
+        squared += diff * diff;
+        relative += diff * diff / (double(reference.data[k]) * reference.data[k] + 0.01);
+    }
+    rmse = std::sqrt(squared / sum.data.size());
+    relmse = relative / sum.data.size();
+}
+
+static bool measure(const scene_entry &entry, const conv_options &options, std::ostream &out, bool first)
+{
+    float_image reference;
+    auto path = reference_path(options, entry.name);
+    if (!read_pfm(path, reference))
+    {
+        std::cerr << "Missing reference '" << path << "', run with --make-reference first\n";
+        return false;
+    }
+
+    scene s = prepare(entry, options, true);
+    float_image sum(options.width, image_height(s));
+    if (sum.height != reference.height)
+    {
+        std::cerr << "Reference '" << path << "' does not match the scene resolution\n";
+        return false;
+    }
+
+    std::vector<error_sample> curve;
+    int spp = 0;
+    double elapsed = 0; // rendering time only; computing the error is not counted
+    double time_to_target = -1;
+    for (unsigned int pass = 0; elapsed < options.seconds; pass++)
+    {
+        auto start = conv_clock::now();
+        spp += accumulate_pass(s, options.pass_spp, pass, sum);
+        elapsed += std::chrono::duration<double>(conv_clock::now() - start).count();
+
+        error_sample e;
+        e.seconds = elapsed;
+        e.spp = spp;
+        compare(sum, spp, reference, e.rmse, e.relmse);
+        curve.push_back(e);
+        if (time_to_target < 0 && e.relmse <= options.target_relmse)
+            time_to_target = elapsed;
+
+        std::clog << "\r" << entry.name << ": " << spp << " spp, relMSE " << e.relmse << "        " << std::flush;
+    }
+    std::clog << "\n";
+
+    // For an unbiased estimator MSE is variance, so 1 / (MSE * time) is the usual Monte Carlo
+    // efficiency; it stays roughly constant as samples accumulate, which makes runs comparable.
+    const auto &last = curve.back();
+    auto efficiency = 1 / (last.rmse * last.rmse * last.seconds);
+    auto relative_efficiency = 1 / (last.relmse * last.seconds);
+
+    char line[512];
+    std::snprintf(line, sizeof(line),
+                  "%s    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"spp\": %d, \"seconds\": %.3f,\n"
+                  "     \"rmse\": %.6g, \"relmse\": %.6g, \"target_relmse\": %g, \"time_to_target_s\": %s,\n"
+                  "     \"efficiency\": %.6g, \"relative_efficiency\": %.6g,\n"
+                  "     \"curve\": [",
+                  first ? "" : ",\n", entry.name.c_str(), sum.width, sum.height, last.spp, last.seconds,
+                  last.rmse, last.relmse, options.target_relmse,
+                  time_to_target < 0 ? "null" : std::to_string(time_to_target).c_str(),
+                  efficiency, relative_efficiency);
+    out << line;
+    for (size_t k = 0; k < curve.size(); k++)
+    {
+        std::snprintf(line, sizeof(line), "%s{\"seconds\": %.3f, \"spp\": %d, \"rmse\": %.6g, \"relmse\": %.6g}",
+                      k ? ", " : "", curve[k].seconds, curve[k].spp, curve[k].rmse, curve[k].relmse);
+        out << line;
+    }
+    out << "]}";
+    return true;
+}
+
+static bool parse_number(const char *text, double &value)
+{
+    char *end;
+    value = std::strtod(text, &end);
+    return end != text && *end == '\0' && value > 0;
+}
+
+int main(int argc, char **argv)
+{
+    conv_options options;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        double number;
+        if (arg == "--make-reference")
+            options.make_reference = true;
+        else if (arg == "--scene" && has_value)
+            options.scenes.push_back(argv[++a]);
+        else if (arg == "--ref-dir" && has_value)
+            options.ref_dir = argv[++a];
+        else if (arg == "--width" && has_value && parse_number(argv[++a], number))
+            options.width = int(number);
+        else if (arg == "--ref-spp" && has_value && parse_number(argv[++a], number))
+            options.ref_spp = int(number);
+        else if (arg == "--pass-spp" && has_value && parse_number(argv[++a], number))
+            options.pass_spp = int(number);
+        else if (arg == "--seconds" && has_value && parse_number(argv[++a], number))
+            options.seconds = number;
+        else if (arg == "--target-relmse" && has_value && parse_number(argv[++a], number))
+            options.target_relmse = number;
+        else if (arg == "--caustics" && has_value && parse_number(argv[++a], number))
+            options.caustic_photons = int(number);
+        else if (arg == "--guide")
+            options.path_guiding = true;
+        else if (arg == "--env" && has_value)
+            options.environment_map = argv[++a];
+        else
+        {
+            std::cerr << "usage: convergence [--make-reference] [--scene name]... [--width N] [--ref-dir dir] [--env image]\n"
+                         "                   [--ref-spp N] [--pass-spp N] [--seconds S] [--target-relmse E] [--caustics photons] [--guide]\n";
+            return 1;
+        }
+    }
+
+    // By default every non-synthetic scene; the stress scenes have no stable look to converge to.
+    std::vector<const scene_entry *> selected;
+    for (const auto &entry : scene_registry())
+        if (options.scenes.empty() && !entry.synthetic)
+            selected.push_back(&entry);
+    for (const auto &name : options.scenes)
+    {
+        auto entry = find_scene(name);
+        if (!entry)
+        {
+            std::cerr << "Unknown scene '" << name << "'\n";
+            return 1;
+        }
+        selected.push_back(entry);
+    }
+
+    if (options.make_reference)
+    {
+        for (auto entry : selected)
+            if (make_reference(*entry, options))
+                return 1;
+        return 0;
+    }
+
+    std::cout << "{\n  \"scenes\": [\n";
+    bool first = true;
+    int failed = 0;
+    for (auto entry : selected)
+    {
+        if (measure(*entry, options, std::cout, first))
+            first = false;
+        else
+            failed++;
+    }
+    std::cout << "\n  ]\n}\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,387 @@
+#include "../tool/rtweekend.h"
+#include "../tool/aabb.h"
+#include "../tool/onb.h"
+#include "../tool/BVH.h"
+#include "../tool/compact_BVH.h"
+#include "../obj/sphere.h"
+#include "../obj/quad.h"
+#include "../render/material.h"
+#include "../render/texture.h"
+#include "../render/perlin.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MICROBENCH_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICROBENCH_HAS_TSC 1
+#else
+#define MICROBENCH_HAS_TSC 0
+#endif
+
+// Microbenchmarks for the individual intersection and sampling kernels.
+//
+// Every kernel runs over a fixed-seed corpus of rays, points, directions and uv pairs, so two
+// builds see exactly the same inputs. "warm" loops many times over a small corpus that stays in
+// L1/L2; "cold" streams once over a large corpus after evicting the caches.
+//
+//   microbench [--filter text] [--reps N] [--save results.tsv] [--compare baseline.tsv]
+//
+// --compare also checks every kernel's checksum against the baseline's, flags the kernels that
+// computed something different and then exits with status 3.
+//
+// To benchmark a new primitive or BVH layout, add one entry to make_kernels().
+
+static unsigned long long read_cycles()
+{
+#if MICROBENCH_HAS_TSC
+    return __rdtsc(); /* 参考周期(TSC)，非核心实际频率 */
+#else
+    return 0;
+#endif
+}
+
+/* 固定种子的输入语料 */
+struct corpus
+{
+    std::vector<ray> rays;        // Origins on a radius-4 sphere, aimed into [-1,1]^3
+    std::vector<point3> points;   // Uniform in [-4,4]^3
+    std::vector<vec3> directions; // Unit vectors
+    std::vector<onb> frames;      // Built from `directions`
+    std::vector<double> u, v;     // Uniform in [0,1)
+    size_t mask;                  // size - 1; the size is a power of two
+
+    corpus(size_t size, unsigned seed) : mask(size - 1)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto range = [&](double lo, double hi)
+        { return lo + (hi - lo) * uniform(rng); };
+        auto unit = [&]()
+        {
+            auto z = range(-1, 1);
+            auto phi = range(0, 2 * pi);
+            auto r = std::sqrt(1 - z * z);
+            return vec3(r * std::cos(phi), r * std::sin(phi), z);
+        };
+
+        rays.reserve(size);
+        points.reserve(size);
+        directions.reserve(size);
+        frames.reserve(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            auto origin = 4 * unit();
+            auto target = point3(range(-1, 1), range(-1, 1), range(-1, 1));
+            rays.push_back(ray(origin, target - origin, uniform(rng)));
+            points.push_back(point3(range(-4, 4), range(-4, 4), range(-4, 4)));
+            directions.push_back(unit());
+            frames.push_back(onb(directions.back()));
+            u.push_back(uniform(rng));
+            v.push_back(uniform(rng));
+        }
+    }
+};
+
+/* 一个内核：运行ops次操作，循环遍历语料，返回校验和以防被优化掉 */
+struct kernel
+{
+    std::string name;
+    std::function<double(const corpus &c, size_t ops)> run;
+};
+
+static std::vector<kernel> make_kernels()
+{
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    std::vector<kernel> kernels;
+
+    auto box = make_shared<aabb>(point3(-1, -1, -1), point3(1, 1, 1));
+    kernels.push_back({"aabb::hit", [box](const corpus &c, size_t ops)
+                       {
+                           double hits = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               hits += box->hit(c.rays[i & c.mask], interval(0.001, infinity));
+                           return hits;
+                       }});
+
+    auto ball = make_shared<sphere>(point3(0, 0, 0), 1, mat);
+    kernels.push_back({"sphere::hit", [ball](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           hit_record rec;
+                           for (size_t i = 0; i < ops; i++)
+                               if (ball->hit(c.rays[i & c.mask], interval(0.001, infinity), rec))
+                                   sum += rec.t;
+                           return sum;
+                       }});
+
+    auto square = make_shared<quad>(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), mat);
+    kernels.push_back({"quad::hit", [square](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           hit_record rec;
+                           for (size_t i = 0; i < ops; i++)
+                               if (square->hit(c.rays[i & c.mask], interval(0.001, infinity), rec))
+                                   sum += rec.t;
+                           return sum;
+                       }});
+
+    kernels.push_back({"onb::transform", [](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               sum += c.frames[i & c.mask].transform(c.directions[(i + 1) & c.mask]).x();
+                           return sum;
+                       }});
+
+    kernels.push_back({"random_cosine_direction", [](const corpus &, size_t ops)
+                       {
+                           double sum = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               sum += random_cosine_direction().z();
+                           return sum;
+                       }});
+
+    auto noise = make_shared<perlin>();
+    kernels.push_back({"perlin::turb", [noise](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               sum += noise->turb(c.points[i & c.mask], 7);
+                           return sum;
+                       }});
+
+    auto image = make_shared<image_texture>("../resource/earthmap.jpg");
+    kernels.push_back({"image_texture::value", [image](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               sum += image->value(c.u[i & c.mask], c.v[i & c.mask], point3(0, 0, 0)).x();
+                           return sum;
+                       }});
+    kernels.push_back({"image_texture::value/lod", [image](const corpus &c, size_t ops)
+                       {
+                           // A footprint of 1/256 in u and v selects a minified level (about 3 for earthmap).
+                           double sum = 0;
+                           for (size_t i = 0; i < ops; i++)
+                               sum += image->value(c.u[i & c.mask], c.v[i & c.mask], point3(0, 0, 0), 1.0 / 256, 1.0 / 256).x();
+                           return sum;
+                       }});
+
+    // 10000 small spheres in [-1,1]^3 under a bvh_node; the tree itself is larger than L2.
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    hittable_list spheres;
+    for (int i = 0; i < 10000; i++)
+        spheres.add(make_shared<sphere>(point3(uniform(rng), uniform(rng), uniform(rng)), 0.02, mat));
+    auto tree = make_shared<bvh_node>(spheres);
+    kernels.push_back({"bvh_node::hit", [tree](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           hit_record rec;
+                           for (size_t i = 0; i < ops; i++)
+                               if (tree->hit(c.rays[i & c.mask], interval(0.001, infinity), rec))
+                                   sum += rec.t;
+                           return sum;
+                       }});
+
+    auto compact = make_shared<compact_bvh>(spheres);
+    kernels.push_back({"compact_bvh::hit", [compact](const corpus &c, size_t ops)
+                       {
+                           double sum = 0;
+                           hit_record rec;
+                           for (size_t i = 0; i < ops; i++)
+                               if (compact->hit(c.rays[i & c.mask], interval(0.001, infinity), rec))
+                                   sum += rec.t;
+                           return sum;
+                       }});
+
+    return kernels;
+}
+
+static void evict_caches()
+{
+    // Stream through a buffer much larger than the last-level cache. Every line is read and
+    // written back, and the buffer outlives the call, so the loop cannot be optimized away.
+    static std::vector<unsigned char> buffer(64 << 20, 1);
+    for (size_t i = 0; i < buffer.size(); i += 64)
+        buffer[i]++;
+}
+
+struct measurement
+{
+    std::string name;
+    std::string mode;
+    double ns_per_op;
+    double ops_per_cycle;
+    double checksum;
+};
+
+static const unsigned checksum_seed = 42;
+
+static measurement measure(const kernel &k, const corpus &c, bool cold, int reps)
+{
+    // Warm: 2^16 ops cycling over the small corpus, after one untimed pass.
+    // Cold: one op per corpus entry, with the caches evicted before every repetition.
+    // Every run starts the generator from the same seed, so all runs of a kernel return the same
+    // checksum, whatever the repetition count; --compare checks it against the baseline's.
+    size_t ops = cold ? c.mask + 1 : size_t(1) << 16;
+    double checksum = 0;
+    if (!cold)
+    {
+        seed_random(checksum_seed);
+        checksum = k.run(c, ops);
+    }
+
+    std::vector<double> ns, cycles;
+    for (int r = 0; r < reps; r++)
+    {
+        if (cold)
+            evict_caches();
+        seed_random(checksum_seed);
+        auto start = std::chrono::steady_clock::now();
+        auto start_cycles = read_cycles();
+        checksum = k.run(c, ops);
+        auto end_cycles = read_cycles();
+        auto end = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / ops);
+        cycles.push_back(double(end_cycles - start_cycles) / ops);
+    }
+
+    // The median is robust against the occasional preempted repetition.
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+    auto median_cycles = cycles[cycles.size() / 2];
+    return {k.name, cold ? "cold" : "warm", ns[ns.size() / 2], median_cycles > 0 ? 1 / median_cycles : 0, checksum};
+}
+
+struct baseline_entry
+{
+    double ns_per_op;
+    double checksum;
+    bool has_checksum;
+};
+
+static std::map<std::string, baseline_entry> load_baseline(const std::string &filename)
+{
+    // name<TAB>mode<TAB>ns/op<TAB>ops/cycle<TAB>checksum as written by --save
+    std::map<std::string, baseline_entry> baseline;
+    std::ifstream in(filename);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string name, mode;
+        baseline_entry entry = {0, 0, false};
+        double ops_per_cycle;
+        if (std::getline(fields, name, '\t') && std::getline(fields, mode, '\t') && fields >> entry.ns_per_op)
+        {
+            entry.has_checksum = bool(fields >> ops_per_cycle >> entry.checksum);
+            baseline[name + '\t' + mode] = entry;
+        }
+    }
+    return baseline;
+}
+
+static bool same_checksum(double a, double b)
+{
+    // Builds may round differently (contracted multiply-adds), so allow for the last few digits.
+    return std::fabs(a - b) <= 1e-9 * std::fmax(1.0, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter, save_file, compare_file;
+    int reps = 5;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--filter" && has_value)
+            filter = argv[++a];
+        else if (arg == "--reps" && has_value)
+            reps = std::max(1, std::atoi(argv[++a]));
+        else if (arg == "--save" && has_value)
+            save_file = argv[++a];
+        else if (arg == "--compare" && has_value)
+            compare_file = argv[++a];
+        else
+        {
+            std::cerr << "usage: microbench [--filter text] [--reps N] [--save results.tsv] [--compare baseline.tsv]\n";
+            return 1;
+        }
+    }
+
+    std::map<std::string, baseline_entry> baseline;
+    if (!compare_file.empty())
+    {
+        baseline = load_baseline(compare_file);
+        if (baseline.empty())
+        {
+            std::cerr << "No results in '" << compare_file << "'\n";
+            return 1;
+        }
+    }
+
+    corpus warm(1 << 10, 1234);
+    corpus cold(1 << 18, 5678); /* 约50MB，超出末级缓存 */
+    auto kernels = make_kernels();
+
+    std::vector<measurement> results;
+    for (const auto &k : kernels)
+    {
+        if (!filter.empty() && k.name.find(filter) == std::string::npos)
+            continue;
+        results.push_back(measure(k, warm, false, reps));
+        results.push_back(measure(k, cold, true, reps));
+    }
+
+    std::printf("%-26s %-5s %10s %10s", "kernel", "mode", "ns/op", "ops/cycle");
+    if (!baseline.empty())
+        std::printf(" %10s %8s", "base ns/op", "speedup");
+    std::printf("\n");
+
+    // A kernel whose checksum differs from the baseline's computed something else, so its timing
+    // is not a like-for-like comparison.
+    int mismatches = 0;
+    for (const auto &m : results)
+    {
+        std::printf("%-26s %-5s %10.3f %10.4f", m.name.c_str(), m.mode.c_str(), m.ns_per_op, m.ops_per_cycle);
+        auto found = baseline.find(m.name + '\t' + m.mode);
+        if (found != baseline.end())
+        {
+            std::printf(" %10.3f %7.2fx", found->second.ns_per_op, found->second.ns_per_op / m.ns_per_op);
+            if (found->second.has_checksum && !same_checksum(found->second.checksum, m.checksum))
+            {
+                std::printf("  checksum differs");
+                mismatches++;
+            }
+        }
+        std::printf("\n");
+    }
+    if (mismatches > 0)
+        std::cerr << mismatches << " kernel(s) computed different results than the baseline\n";
+
+    if (!save_file.empty())
+    {
+        // The checksum lets a comparison confirm both builds computed the same results.
+        std::ofstream out(save_file);
+        for (const auto &m : results)
+            out << m.name << '\t' << m.mode << '\t' << m.ns_per_op << '\t' << m.ops_per_cycle << '\t'
+                << std::setprecision(17) << m.checksum << std::setprecision(6) << '\n';
+    }
+    return mismatches > 0 ? 3 : 0;
+}
@@ -1,20 +1,45 @@
 #include "rtw_stb_image.h"
+#include "../tool/trace.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
 #include "stb_image.h"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <vector>
+
 // 可以在这里包含其他必要的头文件或定义
 
 rtw_image::rtw_image() {}
 
-rtw_image::rtw_image(const char *image_filename)
+rtw_image::rtw_image(const char *image_filename) : source(image_filename) {}
+
+rtw_image::rtw_image(const char *image_filename, bool keep_hdr) : source(image_filename), keep_hdr(keep_hdr) {}
+
+void rtw_image::decode() const
+{
+    std::call_once(decode_once, [this]()
+                   { const_cast<rtw_image *>(this)->find_and_load(); });
+}
+
+void rtw_image::find_and_load()
 {
-    auto filename = std::string(image_filename);
+    if (source.empty())
+        return;
+
+    RT_TRACE_SCOPE("texture decode");
+    auto filename = source;
     auto imagedir = getenv("RTW_IMAGES");
 
     // Hunt for the image file in some likely locations.
-    if (imagedir && load(std::string(imagedir) + "/" + image_filename))
+    if (imagedir && load(std::string(imagedir) + "/" + source))
         return;
     if (load(filename))
         return;
@@ -33,19 +58,22 @@ rtw_image::rtw_image(const char *image_filename)
     if (load("../../../../../../images/" + filename))
         return;
 
-    std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
+    std::cerr << "ERROR: Could not load image file '" << source << "'.\n";
 }
 
 rtw_image::~rtw_image()
 {
-    delete[] bdata;
-    STBI_FREE(fdata);
+    if (bdata)
+        STBI_FREE(bdata);
+    if (hdata)
+        STBI_FREE(hdata);
 }
 const unsigned char *rtw_image::pixel_data(int x, int y) const
 {
     // Return the address of the three RGB bytes of the pixel at x,y. If there is no image
     // data, returns magenta.
     static unsigned char magenta[] = {255, 0, 255};
+    decode();
     if (bdata == nullptr)
         return magenta;
 
@@ -54,30 +82,102 @@ const unsigned char *rtw_image::pixel_data(int x, int y) const
 
     return bdata + y * bytes_per_scanline + x * bytes_per_pixel;
 }
+const float *rtw_image::hdr_pixel_data(int x, int y) const
+{
+    decode();
+    if (hdata == nullptr)
+        return nullptr;
+
+    x = clamp(x, 0, image_width);
+    y = clamp(y, 0, image_height);
+
+    return hdata + size_t(y) * bytes_per_scanline + size_t(x) * bytes_per_pixel;
+}
 bool rtw_image::load(const std::string &filename)
 {
+    // Textures keep the file's own 8-bit sRGB values: a quarter of the memory of floats, and
+    // no banding in the darks as linear bytes would have. Lookups decode them through a table.
+    // Light sources need the unclamped range and keep floats instead (keep_hdr).
     auto n = bytes_per_pixel; // Dummy out parameter: original components per pixel
-    fdata = stbi_loadf(filename.c_str(), &image_width, &image_height, &n, bytes_per_pixel);
-    if (fdata == nullptr)
+    if (keep_hdr)
+        hdata = stbi_loadf(filename.c_str(), &image_width, &image_height, &n, bytes_per_pixel);
+    else
+        bdata = stbi_load(filename.c_str(), &image_width, &image_height, &n, bytes_per_pixel);
+    if (!loaded())
         return false;
 
     bytes_per_scanline = image_width * bytes_per_pixel;
-    convert_to_bytes();
     return true;
 }
-void rtw_image::convert_to_bytes()
+
+static float srgb_decode(double encoded)
 {
-    // Convert the linear floating point pixel data to bytes, storing the resulting byte
-    // data in the `bdata` member.
+    return float(encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4));
+}
 
-    int total_bytes = image_width * image_height * bytes_per_pixel;
-    bdata = new unsigned char[total_bytes];
+const std::array<float, 256> rtw_image::srgb_to_linear = []()
+{
+    std::array<float, 256> table;
+    for (int k = 0; k < 256; k++)
+        table[k] = srgb_decode(k / 255.0);
+    return table;
+}();
 
-    // Iterate through all pixel components, converting from [0.0, 1.0] float values to
-    // unsigned [0, 255] byte values.
+unsigned char rtw_image::linear_to_byte(float value)
+{
+    // The table is increasing, so the nearest byte is next to the first entry not below value.
+    auto upper = std::lower_bound(srgb_to_linear.begin(), srgb_to_linear.end(), value) - srgb_to_linear.begin();
+    if (upper == 0)
+        return 0;
+    if (upper == 256)
+        return 255;
+    return (unsigned char)(value - srgb_to_linear[upper - 1] < srgb_to_linear[upper] - value ? upper - 1 : upper);
+}
+static std::mutex registry_mutex;
+static std::map<std::string, std::weak_ptr<const rtw_image>> registry;
 
-    auto *bptr = bdata;
-    auto *fptr = fdata;
-    for (auto i = 0; i < total_bytes; i++, fptr++, bptr++)
-        *bptr = float_to_byte(*fptr);
-}
\ No newline at end of file
+std::shared_ptr<const rtw_image> image_registry::get(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto &entry = registry[filename];
+    auto image = entry.lock();
+    if (!image)
+    {
+        image = std::make_shared<rtw_image>(filename.c_str());
+        entry = image;
+    }
+    return image;
+}
+
+void image_registry::decode_pending()
+{
+    std::vector<std::shared_ptr<const rtw_image>> images;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto entry = registry.begin(); entry != registry.end();)
+        {
+            if (auto image = entry->second.lock())
+            {
+                images.push_back(image);
+                ++entry;
+            }
+            else
+                entry = registry.erase(entry); /* 已无持有者 */
+        }
+    }
+
+    // decode() runs at most once per image, so already decoded ones cost nothing here.
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (auto k = next++; k < images.size(); k = next++)
+            images[k]->decode();
+    };
+    auto threads = std::min(images.size(), size_t(std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < threads; k++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+}
@@ -2,21 +2,43 @@
 #define RTW_STB_IMAGE_H
 
 #include <string>
+#include <array>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 class rtw_image
 {
 public:
     rtw_image();
-    rtw_image(const char *image_filename);
+    rtw_image(const char *image_filename); // Only records the name; see decode()
+    rtw_image(const char *image_filename, bool keep_hdr); // keep_hdr: keep unclamped floats instead of bytes
     ~rtw_image();
 
+    rtw_image(const rtw_image &) = delete;
+    rtw_image &operator=(const rtw_image &) = delete;
+
     bool load(const std::string &filename);
-    int width() const { return (fdata == nullptr) ? 0 : image_width; }
-    int height() const { return (fdata == nullptr) ? 0 : image_height; }
+
+    // Finds and decodes the file named in the constructor. Runs once, on the first call from any
+    // thread; width(), height() and pixel_data() call it, so images nobody samples are never read.
+    void decode() const;
+
+    int width() const { return decode(), loaded() ? image_width : 0; }
+    int height() const { return decode(), loaded() ? image_height : 0; }
+
+    // The three sRGB-encoded bytes of the pixel at x,y, as stored in the file; byte_to_linear()
+    // decodes them. Images constructed with keep_hdr have no bytes and return magenta.
     const unsigned char *pixel_data(int x, int y) const;
 
+    // The linear RGB floats of the pixel at x,y, not clamped to [0,1]. Only images constructed
+    // with keep_hdr have them; others return null.
+    const float *hdr_pixel_data(int x, int y) const;
+
+    static float byte_to_linear(unsigned char value) { return srgb_to_linear[value]; }
+    static unsigned char linear_to_byte(float value); // Rounds to the nearest sRGB byte
+
     static int clamp(int x, int low, int high)
     {
         // Return the value clamped to the range [low, high).
@@ -26,26 +48,36 @@ public:
             return x;
         return high - 1;
     }
-
-    static unsigned char float_to_byte(float value)
-    {
-        if (value <= 0.0)
-            return 0;
-        if (1.0 <= value)
-            return 255;
-        return static_cast<unsigned char>(256.0 * value);
-    }
 private:
     static const int bytes_per_pixel = 3;
-    float *fdata = nullptr;
-    unsigned char *bdata = nullptr;
+    std::string source;                /* 构造时给出的文件名，延迟解码 */
+    mutable std::once_flag decode_once;
+    unsigned char *bdata = nullptr;    // sRGB 8-bit RGB, the only copy of a texture's pixels
+    bool keep_hdr = false;
+    float *hdata = nullptr;            // Linear float RGB as decoded, instead of bdata with keep_hdr
     int image_width = 0;
     int image_height = 0;
     int bytes_per_scanline = 0;
 
+    static const std::array<float, 256> srgb_to_linear;
 
-    void convert_to_bytes();
+    bool loaded() const { return bdata != nullptr || hdata != nullptr; }
+    void find_and_load();
 };
+
+// Shares decoded images between everyone who names the same file, so a texture used by many
+// materials is read and kept in memory once.
+class image_registry
+{
+public:
+    // The image for `filename`, still undecoded if nobody has sampled it yet. Images stay
+    // registered as long as some holder keeps them alive.
+    static std::shared_ptr<const rtw_image> get(const std::string &filename);
+
+    // Decodes every registered image that is still pending, several files at a time.
+    static void decode_pending();
+};
+
 // Restore MSVC compiler warnings
 #ifdef _MSC_VER
 #pragma warning(pop)
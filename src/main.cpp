@@ -4,258 +4,86 @@
 #include "obj/sphere.h"
 #include "obj/quad.h"
 #include "obj/constant_medium.h"
+#include "obj/grid_medium.h"
+#include "obj/mapped_mesh.h"
 #include "render/camera.h"
+#include "render/animation.h"
 #include "render/material.h"
 #include "tool/BVH.h"
+#include "tool/light_BVH.h"
 #include "external/rtw_stb_image.h"
+#include "render/distributed.h"
+#include "render/preview.h"
+#include "scene/scenes.h"
+#include "scene/render_server.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-// void bouncing_spheres()
-// {
-//     hittable_list world;
-
-//     auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-//     world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
-
-//     for (int a = -11; a < 11; a++)
-//     {
-//         for (int b = -11; b < 11; b++)
-//         {
-//             auto choose_mat = random_double();
-//             point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-//             if ((center - point3(4, 0.2, 0)).length() > 0.9)
-//             {
-//                 shared_ptr<material> sphere_material;
-
-//                 if (choose_mat < 0.8)
-//                 {
-//                     // diffuse
-//                     auto albedo = color::random() * color::random();
-//                     sphere_material = make_shared<lambertian>(albedo);
-//                     auto center2 = center + vec3(0, random_double(0, .5), 0);
-//                     world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
-//                 }
-//                 else if (choose_mat < 0.95)
-//                 {
-//                     // metal
-//                     auto albedo = color::random(0.5, 1);
-//                     auto fuzz = random_double(0, 0.5);
-//                     sphere_material = make_shared<metal>(albedo, fuzz);
-//                     world.add(make_shared<sphere>(center, 0.2, sphere_material));
-//                 }
-//                 else
-//                 {
-//                     // glass
-//                     sphere_material = make_shared<dielectric>(1.5);
-//                     world.add(make_shared<sphere>(center, 0.2, sphere_material));
-//                 }
-//             }
-//         }
-//     }
-
-//     auto material1 = make_shared<dielectric>(1.5);
-//     world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-//     auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-//     world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-//     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-//     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-//     world = hittable_list(make_shared<bvh_node>(world));
-//     camera cam;
-
-//     cam.aspect_ratio = 16.0 / 9.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0.70, 0.80, 1.00);
-
-//     cam.vfov = 20;
-//     cam.lookfrom = point3(13, 2, 3);
-//     cam.lookat = point3(0, 0, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0.6;
-//     cam.focus_dist = 10.0;
-
-//     cam.render(world);
-// }
-// void checkered_spheres()
-// {
-//     hittable_list world;
-
-//     auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-
-//     world.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
-//     world.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
-//     world = hittable_list(make_shared<bvh_node>(world));
-//     camera cam;
-
-//     cam.aspect_ratio = 16.0 / 9.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0.70, 0.80, 1.00);
-
-//     cam.vfov = 20;
-//     cam.lookfrom = point3(13, 2, 3);
-//     cam.lookat = point3(0, 0, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0;
-
-//     cam.render(world);
-// }
-// void earth()
-// {
-//     auto earth_texture = make_shared<image_texture>("../resource/earthmap.jpg");
-//     auto earth_surface = make_shared<lambertian>(earth_texture);
-//     auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
-
-//     camera cam;
-
-//     cam.aspect_ratio = 16.0 / 9.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0.70, 0.80, 1.00);
-
-//     cam.vfov = 20;
-//     cam.lookfrom = point3(0, 0, 12);
-//     cam.lookat = point3(0, 0, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0;
-
-//     cam.render(hittable_list(globe));
-// }
-
-// void perlin_spheres()
-// {
-//     hittable_list world;
-
-//     auto pertext = make_shared<noise_texture>(4);
-//     world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-//     world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
-
-//     camera cam;
-
-//     cam.aspect_ratio = 16.0 / 9.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0.70, 0.80, 1.00);
-
-//     cam.vfov = 20;
-//     cam.lookfrom = point3(13, 2, 3);
-//     cam.lookat = point3(0, 0, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0;
-
-//     cam.render(world);
-// }
-
-// void quads()
-// {
-//     hittable_list world;
-
-//     // Materials
-//     auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
-//     auto back_green = make_shared<lambertian>(color(0.2, 1.0, 0.2));
-//     auto right_blue = make_shared<lambertian>(color(0.2, 0.2, 1.0));
-//     auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
-//     auto lower_teal = make_shared<lambertian>(color(0.2, 0.8, 0.8));
-
-//     // Quads
-//     world.add(make_shared<quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
-//     world.add(make_shared<quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
-//     world.add(make_shared<quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
-//     world.add(make_shared<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
-//     world.add(make_shared<quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
-
-//     camera cam;
-
-//     cam.aspect_ratio = 1.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0.70, 0.80, 1.00);
-
-//     cam.vfov = 80;
-//     cam.lookfrom = point3(0, 0, 9);
-//     cam.lookat = point3(0, 0, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0;
-
-//     cam.render(world);
-// }
-
-// void simple_light()
-// {
-//     hittable_list world;
-
-//     auto pertext = make_shared<noise_texture>(4);
-//     world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-//     world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
-
-//     auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
-//     world.add(make_shared<sphere>(point3(0, 7, 0), 2, difflight));
-//     world.add(make_shared<quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight));
-
-//     camera cam;
-
-//     cam.aspect_ratio = 16.0 / 9.0;
-//     cam.image_width = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth = 50;
-//     cam.background = color(0, 0, 0);
-
-//     cam.vfov = 20;
-//     cam.lookfrom = point3(26, 3, 6);
-//     cam.lookat = point3(0, 2, 0);
-//     cam.vup = vec3(0, 1, 0);
-
-//     cam.defocus_angle = 0;
-
-//     cam.render(world);
-// }
-
-void cornell_box()
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Renders a registered scene to stdout as a PPM image, by default cornell_box.
+//
+//   hello [--scene name] [--threads N] [--caustics photons] [--guide] [--env image] [--workers N [--launcher prefix]... [--share-dir dir]]
+//   hello --serve
+//   hello [--scene name] --preview framebuffer_file
+//   hello [--scene name] [--threads N] --turntable N
+//   hello --convert-mesh model.obj model.rtmesh
+//   hello [--threads N] --animation frames
+//
+// --workers splits the frame between N worker processes (see render/distributed.h); each
+// --launcher is a command prefix such as "ssh node7" under which workers are started in turn.
+// --serve runs the render server of scene/render_server.h on stdin and stdout instead.
+// --preview refines the scene progressively into a shared framebuffer (render/preview.h); every
+// stdin line of camera changes such as "lookfrom=x,y,z lookat=x,y,z vfov=X spp=N" restarts it,
+// and "quit" or the end of input stops it. --turntable renders N views circling the look-at point
+// in one batch over a single scene build, as <scene>_view_000.ppm, ... --caustics renders caustics
+// from a photon map of that many photons (render/photon_map.h), and --guide samples directions from
+// a path guide learned before the render (render/path_guide.h). --env lights the scene with an
+// equirectangular HDR image instead of its background color (render/environment.h).
+// --convert-mesh writes the triangles of an OBJ file as a memory-mapped mesh (obj/mapped_mesh.h).
+// --animation renders that many frames of an animated Cornell box, refitting the BVH between
+// frames (render/animation.h), as cornell_0000.ppm, cornell_0001.ppm, ...
+// The coordinator starts workers as
+//
+//   hello --scene name [--threads N] --share k/N --share-file path
+
+void cornell_box_animation(int frame_count, int threads)
 {
+    scene_arena arena; // Owns every object below; outlives the render
     hittable_list world;
 
-    auto red = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+    auto red = arena.make<lambertian>(color(.65, .05, .05));
+    auto white = arena.make<lambertian>(color(.73, .73, .73));
+    auto green = arena.make<lambertian>(color(.12, .45, .15));
+    auto light = arena.make<diffuse_light>(color(15, 15, 15));
 
-    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
-    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-    world.add(make_shared<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
-    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+    world.add(arena.make<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(arena.make<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    auto light_quad = arena.make<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light);
+    world.add(light_quad);
+    world.add(arena.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(arena.make<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    world.add(arena.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
 
-    // Box
-    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
-    world.add(box1);
+    // Box spinning on the spot
+    auto box1 = arena.make<rotate_y>(box(point3(0, 0, 0), point3(165, 330, 165), white, &arena), 15);
+    world.add(arena.make<translate>(box1, vec3(265, 0, 295)));
 
-    // Glass Sphere
-    auto glass = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(190, 90, 190), 90, glass));
+    // Glass Sphere bouncing on the floor
+    auto glass = arena.make<dielectric>(1.5);
+    auto glass_sphere = arena.make<sphere>(point3(190, 90, 190), 90, glass);
+    world.add(glass_sphere);
 
     world = hittable_list(make_shared<bvh_node>(world));
 
     camera cam;
 
     cam.aspect_ratio = 1.0;
-    cam.image_width = 600;
-    cam.samples_per_pixel = 1000;
+    cam.image_width = 300;
+    cam.samples_per_pixel = 64;
     cam.max_depth = 50;
     cam.background = color(0, 0, 0);
 
@@ -265,89 +93,250 @@ void cornell_box()
     cam.vup = vec3(0, 1, 0);
 
     cam.defocus_angle = 0;
-
-    auto empty_material = shared_ptr<material>();
-    hittable_list lights; /* 光源和球体 */
-    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), empty_material));
-    lights.add(make_shared<sphere>(point3(190, 90, 190), 90, empty_material));
-    cam.render(world, lights);
+    cam.thread_count = threads;
+
+    hittable_list light_list;
+    light_list.add(light_quad);
+    light_list.add(glass_sphere);
+    light_bvh lights(light_list);
+
+    animation anim;
+    anim.frames_per_second = 24;
+    anim.frame_count = frame_count;
+    anim.add([=](double time)
+             { box1->set_angle(15 + 36 * time); });
+    anim.add([=](double time)
+             { glass_sphere->set_center(point3(190, 90 + 150 * std::fabs(std::sin(pi * time)), 190)); });
+
+    anim.render(cam, world, lights, "cornell");
 }
 
-void cornell_smoke()
+static bool parse_share(const char *text, int &share, int &count)
 {
-    hittable_list world;
-
-    auto red = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(7, 7, 7));
-
-    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
-    world.add(make_shared<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light));
-    world.add(make_shared<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
-
-    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
-
-    shared_ptr<hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
-
-    world.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
-    world.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
-
-    camera cam;
-
-    cam.aspect_ratio = 1.0;
-    cam.image_width = 200;
-    cam.samples_per_pixel = 100;
-    cam.max_depth = 50;
-    cam.background = color(0, 0, 0);
-
-    cam.vfov = 40;
-    cam.lookfrom = point3(278, 278, -800);
-    cam.lookat = point3(278, 278, 0);
-    cam.vup = vec3(0, 1, 0);
-
-    cam.defocus_angle = 0;
-
-    auto empty_material = shared_ptr<material>();
-    quad lights(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), empty_material);
-    cam.render(world, lights);
+    return std::sscanf(text, "%d/%d", &share, &count) == 2 && count > 0 && share >= 0 && share < count;
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    cornell_box();
-    // switch (7)
-    // {
-    // case 1:
-    //     bouncing_spheres();
-    //     break;
-    // case 2:
-    //     checkered_spheres();
-    //     break;
-    // case 3:
-    //     earth();
-    //     break;
-    // case 4:
-    //     perlin_spheres();
-    //     break;
-    // case 5:
-    //     quads();
-    //     break;
-    // case 6:
-    //     simple_light();
-    //     break;
-    // case 7:
-    //     cornell_box();
-    //     break;
-    // case 8:
-    //     cornell_smoke();
-    //     break;
-    // }
+    std::string scene_name = "cornell_box";
+    int threads = 0, workers = 0, share = 0, share_count = 0;
+    std::string share_file, share_dir = ".";
+    std::vector<std::string> launchers;
+    bool serve = false;
+    std::string preview_file;
+    int turntable = 0, caustics = 0, animation_frames = 0;
+    bool guide = false;
+    std::string environment;
+    std::string convert_from, convert_to;
+    for (int k = 1; k < argc; k++)
+    {
+        bool has_value = k + 1 < argc;
+        if (!std::strcmp(argv[k], "--scene") && has_value)
+            scene_name = argv[++k];
+        else if (!std::strcmp(argv[k], "--threads") && has_value)
+            threads = std::atoi(argv[++k]);
+        else if (!std::strcmp(argv[k], "--workers") && has_value)
+            workers = std::atoi(argv[++k]);
+        else if (!std::strcmp(argv[k], "--launcher") && has_value)
+            launchers.push_back(argv[++k]);
+        else if (!std::strcmp(argv[k], "--share-dir") && has_value)
+            share_dir = argv[++k];
+        else if (!std::strcmp(argv[k], "--share") && has_value && parse_share(argv[k + 1], share, share_count))
+            k++;
+        else if (!std::strcmp(argv[k], "--share-file") && has_value)
+            share_file = argv[++k];
+        else if (!std::strcmp(argv[k], "--serve"))
+            serve = true;
+        else if (!std::strcmp(argv[k], "--preview") && has_value)
+            preview_file = argv[++k];
+        else if (!std::strcmp(argv[k], "--turntable") && has_value)
+            turntable = std::atoi(argv[++k]);
+        else if (!std::strcmp(argv[k], "--animation") && has_value)
+            animation_frames = std::atoi(argv[++k]);
+        else if (!std::strcmp(argv[k], "--caustics") && has_value)
+            caustics = std::atoi(argv[++k]);
+        else if (!std::strcmp(argv[k], "--guide"))
+            guide = true;
+        else if (!std::strcmp(argv[k], "--env") && has_value)
+            environment = argv[++k];
+        else if (!std::strcmp(argv[k], "--convert-mesh") && k + 2 < argc)
+        {
+            convert_from = argv[++k];
+            convert_to = argv[++k];
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete argument: " << argv[k] << "\n";
+            return 2;
+        }
+    }
+
+    if (serve)
+    {
+        render_server server;
+        server.run(std::cin, std::cout);
+        return 0;
+    }
+
+    if (animation_frames > 0)
+    {
+        cornell_box_animation(animation_frames, threads);
+        return 0;
+    }
+
+    if (!convert_from.empty())
+    {
+        std::vector<mesh_triangle> triangles;
+        if (!read_obj(convert_from, triangles))
+        {
+            std::cerr << "ERROR: Could not read OBJ file '" << convert_from << "'.\n";
+            return 1;
+        }
+        if (!write_mesh_file(convert_to, triangles))
+        {
+            std::cerr << "ERROR: Could not write mesh file '" << convert_to << "'.\n";
+            return 1;
+        }
+        std::clog << triangles.size() << " triangles written to " << convert_to << "\n";
+        return 0;
+    }
+
+    auto entry = find_scene(scene_name);
+    if (!entry)
+    {
+        std::cerr << "Unknown scene: " << scene_name << "\n";
+        return 2;
+    }
+    scene s = entry->make();
+    s.cam.thread_count = threads;
+    s.caustic_photons = caustics;
+    s.use_path_guiding = guide;
+    if (!environment.empty())
+        s.environment_map = environment;
+
+    if (turntable > 0)
+    {
+        s.build();
+        s.train_guide();
+        std::vector<camera> views;
+        auto offset = s.cam.lookfrom - s.cam.lookat;
+        for (int v = 0; v < turntable; v++)
+        {
+            // Rotate the eye about the vertical axis through the look-at point.
+            auto angle = 2 * pi * v / turntable;
+            auto c = s.cam;
+            c.lookfrom = s.cam.lookat + vec3(std::cos(angle) * offset.x() + std::sin(angle) * offset.z(), offset.y(),
+                                             -std::sin(angle) * offset.x() + std::cos(angle) * offset.z());
+            c.initialize();
+            views.push_back(c);
+        }
+
+        std::vector<std::vector<color>> images;
+        camera::render_views(views, s.world, s.light_sampler(), images);
+        for (int v = 0; v < turntable; v++)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "_view_%03d.ppm", v);
+            std::ofstream out(scene_name + name);
+            views[v].write_image(out, images[v]);
+        }
+        std::clog << "\rDone.                 \n";
+        return 0;
+    }
+
+    if (!preview_file.empty())
+    {
+        s.build();
+        auto cam = s.cam;
+        cam.initialize();
+        shared_framebuffer framebuffer;
+        if (!framebuffer.create(preview_file, cam.image_width, cam.height()))
+        {
+            std::cerr << "Could not create the framebuffer " << preview_file << "\n";
+            return 1;
+        }
+
+        preview_renderer preview(s.world, s.light_sampler(), framebuffer);
+        preview.on_pass = [](const preview_pass &pass)
+        { std::clog << "generation " << pass.generation << ": 1/" << pass.scale << " resolution, " << pass.samples
+                    << " spp after " << pass.milliseconds << " ms\n"; };
+        preview.update(cam);
+        for (std::string line; std::getline(std::cin, line) && line != "quit";)
+        {
+            std::istringstream changes(line);
+            for (std::string change; changes >> change;)
+            {
+                double x, y, z;
+                if (std::sscanf(change.c_str(), "lookfrom=%lf,%lf,%lf", &x, &y, &z) == 3)
+                    cam.lookfrom = point3(x, y, z);
+                else if (std::sscanf(change.c_str(), "lookat=%lf,%lf,%lf", &x, &y, &z) == 3)
+                    cam.lookat = point3(x, y, z);
+                else if (std::sscanf(change.c_str(), "vfov=%lf", &x) == 1)
+                    cam.vfov = x;
+                else if (std::sscanf(change.c_str(), "spp=%lf", &x) == 1)
+                    cam.samples_per_pixel = int(x);
+                else
+                    std::cerr << "Unknown camera change: " << change << "\n";
+            }
+            preview.update(cam);
+        }
+        if (std::cin.eof())
+            preview.wait(); // Input ended: let the last camera finish refining
+        return 0;
+    }
+
+    if (share_count > 0)
+    {
+        // Worker: render one tile share into the share file, no image on stdout.
+        if (share_file.empty())
+        {
+            std::cerr << "--share needs --share-file\n";
+            return 2;
+        }
+        share_heartbeat heartbeat(share_file); // Tells the coordinator this worker is alive
+        s.build();
+        s.train_guide(); // Learning is deterministic, so every worker ends up with the same guide
+        s.cam.tile_share = share;
+        s.cam.tile_share_count = share_count;
+        s.cam.tiles_done = heartbeat.tiles_done();
+        s.cam.initialize();
+        std::vector<color> pixels;
+        s.cam.render_image(s.world, s.light_sampler(), pixels);
+        return write_share(share_file, s.cam, pixels) ? 0 : 1;
+    }
+
+    if (workers > 0)
+    {
+        // Coordinator: only the camera is needed here, the workers build the scene themselves.
+        render_coordinator coordinator;
+        coordinator.workers = workers;
+        coordinator.launchers = launchers;
+        coordinator.directory = share_dir;
+        coordinator.worker_command = std::string("\"") + argv[0] + "\" --scene " + scene_name;
+        if (caustics > 0) // Every worker shoots the same photons from the same seed
+            coordinator.worker_command += " --caustics " + std::to_string(caustics);
+        if (guide)
+            coordinator.worker_command += " --guide";
+        if (!environment.empty())
+            coordinator.worker_command += " --env \"" + environment + "\"";
+        if (threads > 0)
+            coordinator.worker_command += " --threads " + std::to_string(threads);
+        else if (launchers.empty()) // Local workers share this machine's hardware threads
+            coordinator.worker_command += " --threads " +
+                                          std::to_string(std::max(1u, std::thread::hardware_concurrency() / workers));
+
+        s.cam.initialize();
+        std::vector<color> pixels;
+        if (!coordinator.render(s.cam, pixels))
+        {
+            std::cerr << "Distributed render failed: a share could not be rendered.\n";
+            return 1;
+        }
+        s.cam.write_image(std::cout, pixels);
+        std::clog << "\rDone.                 \n";
+        return 0;
+    }
+
+    s.render();
+    return 0;
 }
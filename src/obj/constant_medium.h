@@ -18,6 +18,7 @@ class constant_medium : public hittable {
     {}
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_STAT(primitive_tests[stat_constant_medium]);
         hit_record rec1, rec2;
 
         if (!boundary->hit(r, interval::universe, rec1))
@@ -47,12 +48,23 @@ class constant_medium : public hittable {
 
         rec.normal = vec3(1,0,0);  // arbitrary
         rec.front_face = true;     // also arbitrary
+        rec.dpdu = rec.dpdv = 0;   // no texture footprint inside a medium
         rec.mat = phase_function;
+        rec.object = this;
+        RT_STAT(primitive_hits[stat_constant_medium]);
 
         return true;
     }
 
     aabb bounding_box() const override { return boundary->bounding_box(); }
+    aabb bounding_box_at(double time) const override { return boundary->bounding_box_at(time); }
+    void refit() override { boundary->refit(); }
+    shared_ptr<material> surface_material() const override { return phase_function; } // The boundary is never shaded
+    unsigned features() const override
+    {
+        // The boundary only matters for where the medium is, so only its motion counts.
+        return feature_media | hittable::features() | (boundary->features() & feature_motion_blur);
+    }
 
   private:
     shared_ptr<hittable> boundary;
@@ -0,0 +1 @@
+#include "grid_medium.h"
\ No newline at end of file
@@ -0,0 +1,253 @@
+#ifndef GRID_MEDIUM_H
+#define GRID_MEDIUM_H
+
+#include "hittable.h"
+#include "../render/material.h"
+#include "../render/texture.h"
+
+#include <functional>
+#include <vector>
+
+/* 体素密度网格，附带按砖块(brick)统计的粗粒度最大密度(majorant)网格 */
+class density_grid
+{
+public:
+    density_grid(int nx, int ny, int nz, std::vector<float> voxels, int brick_size = 8)
+        : brick(brick_size < 1 ? 1 : brick_size), voxels(std::move(voxels))
+    {
+        n[0] = nx;
+        n[1] = ny;
+        n[2] = nz;
+        build_majorants();
+    }
+
+    density_grid(int nx, int ny, int nz, const std::function<double(const point3 &)> &density_at, int brick_size = 8)
+        : brick(brick_size < 1 ? 1 : brick_size)
+    {
+        // Sample `density_at` at the voxel centers of the unit cube [0,1]^3.
+        n[0] = nx;
+        n[1] = ny;
+        n[2] = nz;
+        voxels.resize(size_t(nx) * ny * nz);
+        for (int k = 0; k < nz; k++)
+            for (int j = 0; j < ny; j++)
+                for (int i = 0; i < nx; i++)
+                    voxels[index(i, j, k)] = float(std::fmax(0.0, density_at(point3((i + 0.5) / nx, (j + 0.5) / ny, (k + 0.5) / nz))));
+        build_majorants();
+    }
+
+    int resolution(int axis) const { return n[axis]; }
+    int bricks(int axis) const { return nb[axis]; }
+    int brick_size() const { return brick; }
+
+    double density(const point3 &g) const
+    {
+        // Trilinear lookup; `g` is in voxel units, with voxel i covering [i, i+1).
+        auto x = g.x() - 0.5, y = g.y() - 0.5, z = g.z() - 0.5;
+        auto i = int(std::floor(x)), j = int(std::floor(y)), k = int(std::floor(z));
+        auto u = x - i, v = y - j, w = z - k;
+
+        auto accum = 0.0;
+        for (int di = 0; di < 2; di++)
+            for (int dj = 0; dj < 2; dj++)
+                for (int dk = 0; dk < 2; dk++)
+                    accum += (di ? u : 1 - u) * (dj ? v : 1 - v) * (dk ? w : 1 - w) * voxel(i + di, j + dj, k + dk);
+        return accum;
+    }
+
+    double majorant(int bx, int by, int bz) const
+    {
+        return majorants[(size_t(bz) * nb[1] + by) * nb[0] + bx];
+    }
+
+private:
+    int n[3];
+    int nb[3];
+    int brick;
+    std::vector<float> voxels;
+    std::vector<float> majorants; /* 每个brick内密度的上界 */
+
+    size_t index(int i, int j, int k) const { return (size_t(k) * n[1] + j) * n[0] + i; }
+
+    float voxel(int i, int j, int k) const
+    {
+        i = i < 0 ? 0 : (i >= n[0] ? n[0] - 1 : i);
+        j = j < 0 ? 0 : (j >= n[1] ? n[1] - 1 : j);
+        k = k < 0 ? 0 : (k >= n[2] ? n[2] - 1 : k);
+        return voxels[index(i, j, k)];
+    }
+
+    void build_majorants()
+    {
+        for (int a = 0; a < 3; a++)
+            nb[a] = (n[a] + brick - 1) / brick;
+        majorants.assign(size_t(nb[0]) * nb[1] * nb[2], 0.0f);
+
+        // Trilinear lookups inside a brick reach one voxel past each face, so include that ring.
+        for (int bz = 0; bz < nb[2]; bz++)
+            for (int by = 0; by < nb[1]; by++)
+                for (int bx = 0; bx < nb[0]; bx++)
+                {
+                    float m = 0;
+                    for (int k = bz * brick - 1; k <= (bz + 1) * brick; k++)
+                        for (int j = by * brick - 1; j <= (by + 1) * brick; j++)
+                            for (int i = bx * brick - 1; i <= (bx + 1) * brick; i++)
+                                m = std::fmax(m, voxel(i, j, k));
+                    majorants[(size_t(bz) * nb[1] + by) * nb[0] + bx] = m;
+                }
+    }
+};
+
+/* 非均匀介质：用delta tracking采样散射点，ratio tracking估计透射率 */
+class grid_medium : public hittable
+{
+public:
+    grid_medium(shared_ptr<density_grid> grid, const aabb &bounds, double density_scale, shared_ptr<texture> tex)
+        : grid(grid), bounds(bounds), density_scale(density_scale),
+          phase_function(make_shared<isotropic>(tex))
+    {
+    }
+
+    grid_medium(shared_ptr<density_grid> grid, const aabb &bounds, double density_scale, const color &albedo)
+        : grid(grid), bounds(bounds), density_scale(density_scale),
+          phase_function(make_shared<isotropic>(albedo))
+    {
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        // Delta tracking: sample tentative collisions against the local brick majorant and accept
+        // each one with probability density / majorant.
+        RT_STAT(primitive_tests[stat_grid_medium]);
+        if (media_pass::on())
+        {
+            media_pass::note(*this, r); // Crossed, not scattered in; see media_pass
+            return false;
+        }
+        double t_hit;
+        if (!track(r, ray_t, nullptr, t_hit))
+            return false;
+
+        rec.t = t_hit;
+        rec.p = r.at(rec.t);
+
+        rec.normal = vec3(1, 0, 0); // arbitrary
+        rec.front_face = true;      // also arbitrary
+        rec.u = rec.v = 0;
+        rec.dpdu = rec.dpdv = 0;
+        rec.mat = phase_function;
+        rec.object = this;
+        RT_STAT(primitive_hits[stat_grid_medium]);
+
+        return true;
+    }
+
+    double transmittance(const ray &r, interval ray_t) const override
+    {
+        // Ratio tracking: the same tentative collisions, but weighting by the null-collision
+        // probability instead of terminating, which gives an unbiased low-variance estimate.
+        double transmittance = 1.0;
+        double t_hit;
+        track(r, ray_t, &transmittance, t_hit);
+        return transmittance;
+    }
+
+    aabb bounding_box() const override { return bounds; }
+    shared_ptr<material> surface_material() const override { return phase_function; }
+    unsigned features() const override { return feature_media | hittable::features(); }
+
+private:
+    shared_ptr<density_grid> grid;
+    aabb bounds;
+    double density_scale;
+    shared_ptr<material> phase_function;
+
+    // Walks the majorant bricks along the ray with a 3D DDA. With `transmittance` null it stops at
+    // the first real collision (delta tracking); otherwise it multiplies in 1 - density/majorant at
+    // every tentative collision and runs to the end of the segment (ratio tracking).
+    bool track(const ray &r, interval ray_t, double *transmittance, double &t_hit) const
+    {
+        // Entry and exit come from one slab test against the grid bounds.
+        if (!bounds.clip(r, ray_t))
+            return false;
+
+        auto ray_length = r.direction().length();
+        auto B = double(grid->brick_size());
+
+        // Ray in voxel coordinates: g(t) = go + t * gd.
+        double go[3], gd[3];
+        int cell[3], step[3];
+        double t_next[3], t_delta[3];
+        for (int a = 0; a < 3; a++)
+        {
+            const interval &ax = bounds.axis_interval(a);
+            auto scale = grid->resolution(a) / ax.size();
+            go[a] = (r.origin()[a] - ax.min) * scale;
+            gd[a] = r.direction()[a] * scale;
+
+            auto pos = go[a] + ray_t.min * gd[a];
+            cell[a] = int(std::floor(pos / B));
+            cell[a] = cell[a] < 0 ? 0 : (cell[a] >= grid->bricks(a) ? grid->bricks(a) - 1 : cell[a]);
+
+            if (gd[a] > 0)
+            {
+                step[a] = 1;
+                t_next[a] = ((cell[a] + 1) * B - go[a]) / gd[a];
+                t_delta[a] = B / gd[a];
+            }
+            else if (gd[a] < 0)
+            {
+                step[a] = -1;
+                t_next[a] = (cell[a] * B - go[a]) / gd[a];
+                t_delta[a] = -B / gd[a];
+            }
+            else
+            {
+                step[a] = 0;
+                t_next[a] = infinity;
+                t_delta[a] = infinity;
+            }
+        }
+
+        auto t = ray_t.min;
+        while (t < ray_t.max)
+        {
+            int axis = (t_next[0] < t_next[1]) ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+            auto t_exit = std::fmin(t_next[axis], ray_t.max);
+            auto sigma_max = density_scale * grid->majorant(cell[0], cell[1], cell[2]);
+
+            // Empty bricks are skipped without drawing a single random number.
+            while (sigma_max > 0)
+            {
+                t += -std::log(1 - random_double()) / (sigma_max * ray_length);
+                if (t >= t_exit)
+                    break;
+
+                auto g = point3(go[0] + t * gd[0], go[1] + t * gd[1], go[2] + t * gd[2]);
+                auto sigma = density_scale * grid->density(g);
+
+                if (transmittance)
+                {
+                    *transmittance *= 1 - sigma / sigma_max;
+                    if (*transmittance <= 0)
+                        return false;
+                }
+                else if (random_double() * sigma_max < sigma)
+                {
+                    t_hit = t;
+                    return true;
+                }
+            }
+
+            t = t_exit;
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= grid->bricks(axis))
+                break;
+            t_next[axis] += t_delta[axis];
+        }
+
+        return false;
+    }
+};
+
+#endif
@@ -1 +1,14 @@
 #include "hittable.h"
+#include "../render/material.h"
+
+thread_local media_pass *media_pass::active = nullptr;
+
+unsigned hittable::features() const
+{
+    unsigned used = 0;
+    for_each_child([&used](const hittable &child)
+                   { used |= child.features(); });
+    if (auto mat = surface_material())
+        used |= mat->features();
+    return used;
+}
@@ -5,7 +5,23 @@
 #include "../render/ray.h"
 #include "../tool/aabb.h"
 #include "../tool/aabb.h"
+
+#include <functional>
+#include <vector>
 class material;
+class hittable;
+
+/* 场景用到的特性：积分器为没用到的特性编译出不带相应分支的版本 */
+enum scene_feature : unsigned
+{
+    feature_motion_blur = 1 << 0, // Objects that move during the shutter interval
+    feature_defocus = 1 << 1,     // Depth of field; a camera setting that hittables never report
+    feature_emitters = 1 << 2,    // Materials that emit light
+    feature_specular = 1 << 3,    // Materials that scatter along a single direction (skip_pdf)
+    feature_media = 1 << 4,       // Participating media
+    feature_textures = 1 << 5,    // Materials with a texture other than a solid color
+    feature_all = (1 << 6) - 1
+};
 /* 交点信息 */
 class hit_record
 {
@@ -13,10 +29,18 @@ public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
+    const hittable *object; /* 被击中的图元，用于光源PDF查询 */
     double u;
     double v;
     double t;
     bool front_face;
+    double footprint = 0; // Width of the ray cone at p; set by the integrator, 0 for a point sample
+    double dpdu = 0;      // World distance per unit of u, 0 if the primitive does not provide it
+    double dpdv = 0;      // World distance per unit of v
+
+    // The footprint measured in texture coordinates, for filtered texture lookups.
+    double footprint_u() const { return dpdu > 0 ? footprint / dpdu : 0; }
+    double footprint_v() const { return dpdv > 0 ? footprint / dpdv : 0; }
 
     void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
@@ -36,6 +60,22 @@ public:
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0; /* 光线和物体求交 */
     virtual aabb bounding_box() const = 0;                                     /* 物体包围盒 */
 
+    // Bounds at a given ray time in [0,1]. bounding_box() covers the whole shutter interval;
+    // only moving objects need to override this.
+    virtual aabb bounding_box_at(double time) const { return bounding_box(); }
+
+    // Recompute cached bounds after an animated object below this one has moved.
+    virtual void refit() {}
+
+    // Scene analysis: visits each hittable directly below this one (list members, tree children,
+    // instanced objects), and names the material a primitive shades its hits with.
+    virtual void for_each_child(const std::function<void(const hittable &)> &visit) const {}
+    virtual shared_ptr<material> surface_material() const { return nullptr; }
+
+    // The scene_feature bits used by this hittable and everything below it: by default those of
+    // the children and of the surface material. Primitives add what their geometry needs.
+    virtual unsigned features() const;
+
     virtual double pdf_value(const point3 &origin, const vec3 &direction) const
     {
         return 0.0;
@@ -45,6 +85,76 @@ public:
     {
         return vec3(1, 0, 0);
     }
+
+    // Light tracing: picks a point uniformly on the surface and fills `rec` as a hit there seen
+    // from outside (p, normal, u, v, mat, object). Returns the surface area, or 0 if this
+    // hittable cannot be sampled like that.
+    virtual double sample_surface(hit_record &rec) const { return 0; }
+
+    // Like random, but also reports which primitive the direction was sampled towards.
+    virtual vec3 random(const point3 &origin, const hittable *&sampled) const
+    {
+        sampled = this;
+        return random(origin);
+    }
+
+    // Same as pdf_value, but for a direction whose ray has already been traced and found to hit
+    // `rec`; no intersection test is needed, and only the primitive in rec.object contributes.
+    virtual double hit_pdf_value(const point3 &origin, const vec3 &direction, const hit_record &rec) const
+    {
+        return 0.0;
+    }
+
+    // Participating media: an unbiased estimate of the fraction of light that crosses r over
+    // ray_t without scattering. Media that take part in a media_pass override this.
+    virtual double transmittance(const ray &r, interval ray_t) const { return 1.0; }
+};
+
+/* 光源采样的射线穿过介质：不在介质中散射，而是乘以透射率 */
+// While a media_pass is alive, hits on this thread pass through the media that support it
+// (grid_medium): instead of sampling a collision they note themselves with the ray they were
+// tested with, in their own space. Once the trace has found the surface it reaches,
+// transmittance() multiplies the media's ratio-tracked transmittances up to that surface. The
+// camera traces its light samples like this, so a light behind a cloud is dimmed rather than
+// lost whenever a collision happens to be sampled in front of it.
+class media_pass
+{
+public:
+    media_pass() : previous(active) { active = this; }
+    ~media_pass() { active = previous; }
+
+    media_pass(const media_pass &) = delete;
+    media_pass &operator=(const media_pass &) = delete;
+
+    static bool on() { return active != nullptr; }
+
+    static void note(const hittable &medium, const ray &r)
+    {
+        for (const auto &c : active->crossed)
+            if (c.medium == &medium)
+                return; // Tested again by another traversal path; count it once
+        active->crossed.push_back({&medium, r});
+    }
+
+    // Transmittance of every noted medium over ray_t (the same t along every ray).
+    double transmittance(interval ray_t) const
+    {
+        double product = 1.0;
+        for (const auto &c : crossed)
+            if ((product *= c.medium->transmittance(c.r, ray_t)) <= 0)
+                break;
+        return product;
+    }
+
+private:
+    struct crossing
+    {
+        const hittable *medium;
+        ray r;
+    };
+    std::vector<crossing> crossed;
+    media_pass *previous;
+    static thread_local media_pass *active;
 };
 class translate : public hittable
 {
@@ -70,6 +180,21 @@ public:
         return true;
     }
     aabb bounding_box() const override { return bbox; }
+    aabb bounding_box_at(double time) const override { return object->bounding_box_at(time) + offset; }
+
+    void set_offset(const vec3 &new_offset) /* 动画：移动物体 */
+    {
+        offset = new_offset;
+        bbox = object->bounding_box() + offset;
+    }
+
+    void refit() override
+    {
+        object->refit();
+        bbox = object->bounding_box() + offset;
+    }
+
+    void for_each_child(const std::function<void(const hittable &)> &visit) const override { visit(*object); }
 
 private:
     shared_ptr<hittable> object;
@@ -80,40 +205,16 @@ class rotate_y : public hittable
 {
 public:
     rotate_y(shared_ptr<hittable> object, double angle) : object(object)
+    {
+        set_angle(angle);
+    }
+
+    void set_angle(double angle) /* 动画：旋转物体 */
     {
         auto radians = degrees_to_radians(angle);
         sin_theta = std::sin(radians);
         cos_theta = std::cos(radians);
-        bbox = object->bounding_box();
-
-        point3 min(infinity, infinity, infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++)
-        {
-            for (int j = 0; j < 2; j++)
-            {
-                for (int k = 0; k < 2; k++)
-                {
-                    auto x = i * bbox.x.max + (1 - i) * bbox.x.min;
-                    auto y = j * bbox.y.max + (1 - j) * bbox.y.min;
-                    auto z = k * bbox.z.max + (1 - k) * bbox.z.min;
-
-                    auto newx = cos_theta * x + sin_theta * z;
-                    auto newz = -sin_theta * x + cos_theta * z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++)
-                    {
-                        min[c] = std::fmin(min[c], tester[c]);
-                        max[c] = std::fmax(max[c], tester[c]);
-                    }
-                }
-            }
-        }
-
-        bbox = aabb(min, max);
+        bbox = rotated_box(object->bounding_box());
     }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
@@ -153,12 +254,53 @@ public:
         return true;
     }
     aabb bounding_box() const override { return bbox; }
+    aabb bounding_box_at(double time) const override { return rotated_box(object->bounding_box_at(time)); }
+
+    void refit() override
+    {
+        object->refit();
+        bbox = rotated_box(object->bounding_box());
+    }
+
+    void for_each_child(const std::function<void(const hittable &)> &visit) const override { visit(*object); }
 
 private:
     shared_ptr<hittable> object;
     double sin_theta;
     double cos_theta;
     aabb bbox;
+
+    aabb rotated_box(const aabb &box) const /* 旋转后8个顶点的包围盒 */
+    {
+        point3 min(infinity, infinity, infinity);
+        point3 max(-infinity, -infinity, -infinity);
+
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                for (int k = 0; k < 2; k++)
+                {
+                    auto x = i * box.x.max + (1 - i) * box.x.min;
+                    auto y = j * box.y.max + (1 - j) * box.y.min;
+                    auto z = k * box.z.max + (1 - k) * box.z.min;
+
+                    auto newx = cos_theta * x + sin_theta * z;
+                    auto newz = -sin_theta * x + cos_theta * z;
+
+                    vec3 tester(newx, y, newz);
+
+                    for (int c = 0; c < 3; c++)
+                    {
+                        min[c] = std::fmin(min[c], tester[c]);
+                        max[c] = std::fmax(max[c], tester[c]);
+                    }
+                }
+            }
+        }
+
+        return aabb(min, max);
+    }
 };
 
 #endif
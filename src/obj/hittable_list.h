@@ -46,7 +46,30 @@ public:
         return hit_anything;
     }
     aabb bounding_box() const override { return bbox; }
+    void refit() override
+    {
+        bbox = aabb();
+        for (const auto &object : objects)
+        {
+            object->refit();
+            bbox = aabb(bbox, object->bounding_box());
+        }
+    }
+    void for_each_child(const std::function<void(const hittable &)> &visit) const override
+    {
+        for (const auto &object : objects)
+            visit(*object);
+    }
+    aabb bounding_box_at(double time) const override
+    {
+        aabb box = aabb::empty;
+        for (const auto &object : objects)
+            box = aabb(box, object->bounding_box_at(time));
+        return box;
+    }
     double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (objects.empty())
+            return 0.0;
         auto weight = 1.0 / objects.size();
         auto sum = 0.0;
 
@@ -56,10 +79,35 @@ public:
         return sum;
     }
 
+    double hit_pdf_value(const point3 &origin, const vec3 &direction, const hit_record &rec) const override
+    {
+        if (objects.empty())
+            return 0.0;
+        auto weight = 1.0 / objects.size();
+        auto sum = 0.0;
+
+        for (const auto &object : objects)
+            sum += weight * object->hit_pdf_value(origin, direction, rec);
+
+        return sum;
+    }
+
     vec3 random(const point3& origin) const override {
+        if (objects.empty())
+            return vec3(1, 0, 0);
         auto int_size = int(objects.size());
         return objects[random_int(0, int_size-1)]->random(origin);
     }
+
+    vec3 random(const point3 &origin, const hittable *&sampled) const override
+    {
+        // An empty light set yields no light: the caller sees sampled == nullptr and rejects it.
+        sampled = nullptr;
+        if (objects.empty())
+            return vec3(1, 0, 0);
+        auto int_size = int(objects.size());
+        return objects[random_int(0, int_size - 1)]->random(origin, sampled);
+    }
     private:
     aabb bbox;
 };
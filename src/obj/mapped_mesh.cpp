@@ -0,0 +1,416 @@
+#include "mapped_mesh.h"
+#include "../tool/trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char mesh_magic[8] = "RTMESH1";
+static const std::uint32_t mesh_version = 1;
+static const std::uint32_t mesh_endian_check = 0x01020304;
+
+bool mapped_file::open(const std::string &filename)
+{
+    close();
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        close();
+        return false;
+    }
+    base = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base)
+    {
+        close();
+        return false;
+    }
+    length = size_t(size.QuadPart);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    if (address == MAP_FAILED)
+        return false;
+    madvise(address, size_t(info.st_size), MADV_RANDOM); /* BVH遍历是随机访问，关闭预读 */
+    base = static_cast<const unsigned char *>(address);
+    length = size_t(info.st_size);
+#endif
+    return true;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    mapping = file = nullptr;
+#else
+    if (base)
+        munmap(const_cast<unsigned char *>(base), length);
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+mapped_mesh::mapped_mesh(const std::string &filename, shared_ptr<material> mat) : mat(mat)
+{
+    RT_TRACE_SCOPE("mesh map");
+    if (!file.open(filename))
+    {
+        std::cerr << "ERROR: Could not map mesh file '" << filename << "'.\n";
+        return;
+    }
+
+    // Only the header is checked here; the records are read in place during traversal.
+    mesh_file_header header;
+    if (file.size() < sizeof(header))
+    {
+        std::cerr << "ERROR: '" << filename << "' is not a mesh file.\n";
+        return;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    auto fits = [&](std::uint64_t offset, std::uint64_t count, size_t record)
+    {
+        return offset % 16 == 0 && offset <= file.size() && count <= (file.size() - offset) / record;
+    };
+    if (std::memcmp(header.magic, mesh_magic, sizeof(mesh_magic)) != 0 || header.version != mesh_version ||
+        header.endian_check != mesh_endian_check || header.node_count == 0 ||
+        !fits(header.node_offset, header.node_count, sizeof(mesh_file_node)) ||
+        !fits(header.triangle_offset, header.triangle_count, sizeof(mesh_file_triangle)))
+    {
+        std::cerr << "ERROR: '" << filename << "' is not a valid mesh file.\n";
+        file.close();
+        return;
+    }
+
+    nodes = reinterpret_cast<const mesh_file_node *>(file.data() + header.node_offset);
+    triangles = reinterpret_cast<const mesh_file_triangle *>(file.data() + header.triangle_offset);
+    nodes_in_file = size_t(header.node_count);
+    triangles_in_file = size_t(header.triangle_count);
+    bbox = aabb(point3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]),
+                point3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]));
+}
+
+/* 写文件：在内存中用分桶SAH构建BVH，按深度优先顺序输出 */
+namespace
+{
+    struct build_box
+    {
+        float lo[3] = {1e30f, 1e30f, 1e30f};
+        float hi[3] = {-1e30f, -1e30f, -1e30f};
+
+        void grow(const float p[3])
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+        void grow(const build_box &b)
+        {
+            grow(b.lo);
+            grow(b.hi);
+        }
+        float area() const
+        {
+            if (lo[0] > hi[0])
+                return 0;
+            float d[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+            return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+        }
+    };
+
+    struct build_triangle
+    {
+        mesh_file_triangle record;
+        build_box box;
+        float centroid[3];
+    };
+
+    class mesh_builder
+    {
+    public:
+        static const int max_leaf = 4;
+        static const int max_depth = 60; // Traversal keeps a 64 entry stack
+        static const int bin_count = 12;
+
+        std::vector<build_triangle> tris;
+        std::vector<mesh_file_node> nodes;
+        std::vector<mesh_file_triangle> ordered;
+
+        void build(size_t start, size_t end, int depth)
+        {
+            auto index = nodes.size();
+            nodes.emplace_back();
+
+            build_box bounds, centroids;
+            for (size_t k = start; k < end; k++)
+            {
+                bounds.grow(tris[k].box);
+                centroids.grow(tris[k].centroid);
+            }
+
+            int axis = 0;
+            size_t mid = split(start, end, bounds, centroids, axis);
+            if (end - start <= max_leaf || depth >= max_depth || mid == start || mid == end)
+            {
+                auto &leaf = nodes[index];
+                set_bounds(leaf, bounds);
+                leaf.offset = std::uint32_t(ordered.size());
+                leaf.count = std::uint16_t(end - start);
+                leaf.axis = 0;
+                for (size_t k = start; k < end; k++)
+                    ordered.push_back(tris[k].record);
+                return;
+            }
+
+            build(start, mid, depth + 1);
+            auto right = nodes.size();
+            build(mid, end, depth + 1);
+
+            auto &node = nodes[index]; // Reference taken after the children grew the vector
+            set_bounds(node, bounds);
+            node.offset = std::uint32_t(right - index);
+            node.count = 0;
+            node.axis = std::uint16_t(axis);
+        }
+
+    private:
+        static void set_bounds(mesh_file_node &node, const build_box &b)
+        {
+            // Pad by a relative epsilon: the stored edges are rounded to float, so hits on the
+            // reconstructed triangles may land a hair outside the exact bounds.
+            for (int a = 0; a < 3; a++)
+            {
+                auto pad = 1e-5f * std::max(1.0f, std::max(std::fabs(b.lo[a]), std::fabs(b.hi[a])));
+                node.bounds_min[a] = b.lo[a] - pad;
+                node.bounds_max[a] = b.hi[a] + pad;
+            }
+        }
+
+        size_t split(size_t start, size_t end, const build_box &bounds, const build_box &centroids, int &best_axis)
+        {
+            // Binned SAH over the centroid bounds; returns start when no split beats a leaf.
+            if (end - start <= max_leaf && end - start < 65536)
+                return start;
+            float best_cost = (end - start < 65536) ? float(end - start) * bounds.area() : 1e38f;
+            int best_bin = -1;
+            best_axis = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                auto extent = centroids.hi[axis] - centroids.lo[axis];
+                if (extent <= 0)
+                    continue;
+                build_box bin_box[bin_count];
+                size_t bin_size[bin_count] = {};
+                for (size_t k = start; k < end; k++)
+                {
+                    int b = std::min(bin_count - 1, int(bin_count * (tris[k].centroid[axis] - centroids.lo[axis]) / extent));
+                    bin_box[b].grow(tris[k].box);
+                    bin_size[b]++;
+                }
+                build_box left_box[bin_count];
+                size_t left_size[bin_count];
+                build_box running;
+                size_t count = 0;
+                for (int b = 0; b < bin_count; b++)
+                {
+                    running.grow(bin_box[b]);
+                    count += bin_size[b];
+                    left_box[b] = running;
+                    left_size[b] = count;
+                }
+                running = build_box();
+                count = 0;
+                for (int b = bin_count - 1; b > 0; b--)
+                {
+                    running.grow(bin_box[b]);
+                    count += bin_size[b];
+                    if (left_size[b - 1] == 0 || count == 0)
+                        continue;
+                    auto cost = float(left_size[b - 1]) * left_box[b - 1].area() + float(count) * running.area();
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = b;
+                    }
+                }
+            }
+            if (best_bin < 0)
+            {
+                if (end - start < 65536)
+                    return start;
+                best_axis = 0; // Too many for one leaf and no useful split: halve by index
+                return start + (end - start) / 2;
+            }
+
+            auto extent = centroids.hi[best_axis] - centroids.lo[best_axis];
+            auto middle = std::partition(tris.begin() + start, tris.begin() + end, [&](const build_triangle &t)
+                                         { return std::min(bin_count - 1, int(bin_count * (t.centroid[best_axis] - centroids.lo[best_axis]) / extent)) < best_bin; });
+            return size_t(middle - tris.begin());
+        }
+    };
+}
+
+bool write_mesh_file(const std::string &filename, const std::vector<mesh_triangle> &triangles)
+{
+    RT_TRACE_SCOPE("mesh write");
+    mesh_builder builder;
+    builder.tris.reserve(triangles.size());
+    for (const auto &t : triangles)
+    {
+        build_triangle b;
+        auto e1 = t.b - t.a, e2 = t.c - t.a;
+        auto n = cross(e1, e2);
+        if (n.length_squared() <= 0)
+            continue; // Degenerate triangles never hit
+        n = unit_vector(n);
+        for (int a = 0; a < 3; a++)
+        {
+            b.record.v0[a] = float(t.a[a]);
+            b.record.e1[a] = float(e1[a]);
+            b.record.e2[a] = float(e2[a]);
+            b.record.normal[a] = float(n[a]);
+        }
+        float corner[3][3];
+        for (int a = 0; a < 3; a++)
+        {
+            corner[0][a] = b.record.v0[a];
+            corner[1][a] = b.record.v0[a] + b.record.e1[a];
+            corner[2][a] = b.record.v0[a] + b.record.e2[a];
+        }
+        for (int k = 0; k < 3; k++)
+            b.box.grow(corner[k]);
+        for (int a = 0; a < 3; a++)
+            b.centroid[a] = (corner[0][a] + corner[1][a] + corner[2][a]) / 3;
+        builder.tris.push_back(b);
+    }
+    if (builder.tris.empty())
+        return false;
+
+    builder.build(0, builder.tris.size(), 0);
+
+    mesh_file_header header = {};
+    std::memcpy(header.magic, mesh_magic, sizeof(mesh_magic));
+    header.version = mesh_version;
+    header.endian_check = mesh_endian_check;
+    header.node_offset = sizeof(header);
+    header.node_count = builder.nodes.size();
+    header.triangle_offset = header.node_offset + header.node_count * sizeof(mesh_file_node);
+    header.triangle_count = builder.ordered.size();
+    for (int a = 0; a < 3; a++)
+    {
+        header.bounds_min[a] = builder.nodes[0].bounds_min[a];
+        header.bounds_max[a] = builder.nodes[0].bounds_max[a];
+    }
+
+    // Write under a name of this writer's own, so two processes creating the same mesh at once
+    // never write into one file, then rename it into place.
+    auto partial = filename + "." + std::to_string(std::random_device()()) + ".part";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(builder.nodes.data()), builder.nodes.size() * sizeof(mesh_file_node));
+        out.write(reinterpret_cast<const char *>(builder.ordered.data()), builder.ordered.size() * sizeof(mesh_file_triangle));
+        if (!out.flush())
+        {
+            out.close();
+            std::remove(partial.c_str());
+            return false;
+        }
+    }
+    if (std::rename(partial.c_str(), filename.c_str()) != 0)
+    {
+        // Windows does not rename over an existing file; it also refuses to delete one that is
+        // mapped, in which case the mapped file stays and is as good as ours.
+        std::remove(filename.c_str());
+        if (std::rename(partial.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(partial.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_obj(const std::string &filename, std::vector<mesh_triangle> &triangles)
+{
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    std::vector<point3> vertices;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string type;
+        fields >> type;
+        if (type == "v")
+        {
+            double x, y, z;
+            fields >> x >> y >> z;
+            vertices.push_back(point3(x, y, z));
+        }
+        else if (type == "f")
+        {
+            // Vertex references look like i, i/t, i//n or i/t/n; negative ones count from the end.
+            std::vector<long> face;
+            std::string ref;
+            while (fields >> ref)
+            {
+                long index = std::strtol(ref.c_str(), nullptr, 10);
+                face.push_back(index < 0 ? long(vertices.size()) + index : index - 1);
+            }
+            for (size_t k = 2; k < face.size(); k++)
+            {
+                if (face[0] < 0 || face[k - 1] < 0 || face[k] < 0 || size_t(std::max({face[0], face[k - 1], face[k]})) >= vertices.size())
+                    return false;
+                triangles.push_back({vertices[face[0]], vertices[face[k - 1]], vertices[face[k]]});
+            }
+        }
+    }
+    return true;
+}
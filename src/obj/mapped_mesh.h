@@ -0,0 +1,228 @@
+#ifndef MAPPED_MESH_H
+#define MAPPED_MESH_H
+
+#include "hittable.h"
+#include "../tool/stats.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Triangle meshes stored together with a prebuilt BVH in one file that is traversed directly from
+// a read-only memory mapping. Nothing is deserialized: opening a file maps it and checks the
+// header, and the operating system pages nodes and triangles in as traversal touches them, so a
+// mesh may be much larger than RAM and a big scene starts in milliseconds.
+//
+// Layout (little-endian, every record 16-byte aligned, all offsets relative to the file start):
+//
+//   mesh_file_header    80 bytes
+//   mesh_file_node[]    32 bytes each, depth first: a node's left child follows it directly
+//   mesh_file_triangle[] 48 bytes each, grouped by leaf
+//
+// Files are written by write_mesh_file(); read_obj() reads Wavefront OBJ geometry for it, which
+// `hello --convert-mesh in.obj out.rtmesh` uses to convert models.
+
+struct mesh_file_header
+{
+    char magic[8]; // "RTMESH1"
+    std::uint32_t version;
+    std::uint32_t endian_check; // 0x01020304 as written by the producer
+    std::uint64_t node_offset;
+    std::uint64_t node_count;
+    std::uint64_t triangle_offset;
+    std::uint64_t triangle_count;
+    float bounds_min[3], bounds_max[3]; /* 整个网格的包围盒 */
+    std::uint32_t reserved[2];
+};
+
+struct mesh_file_node
+{
+    float bounds_min[3], bounds_max[3];
+    std::uint32_t offset; // Interior: index distance to the right child. Leaf: first triangle.
+    std::uint16_t count;  // Triangles in a leaf, 0 for an interior node
+    std::uint16_t axis;   // Split axis, used to visit the nearer child first
+};
+
+struct mesh_file_triangle
+{
+    float v0[3];
+    float e1[3]; // v1 - v0
+    float e2[3]; // v2 - v0
+    float normal[3];
+};
+
+static_assert(sizeof(mesh_file_header) == 80, "mesh_file_header must stay 80 bytes");
+static_assert(sizeof(mesh_file_node) == 32, "mesh_file_node must stay 32 bytes");
+static_assert(sizeof(mesh_file_triangle) == 48, "mesh_file_triangle must stay 48 bytes");
+
+struct mesh_triangle /* 写文件前的三角形 */
+{
+    point3 a, b, c;
+};
+
+// Builds a SAH BVH over `triangles` and writes the mesh file. The file appears under its final
+// name only once complete, replacing any older one, so a process that has the old file mapped
+// keeps reading it and nobody maps half a file. Returns false on I/O failure.
+bool write_mesh_file(const std::string &filename, const std::vector<mesh_triangle> &triangles);
+
+// Appends the faces of an OBJ file (v and f records; polygons are fanned into triangles).
+bool read_obj(const std::string &filename, std::vector<mesh_triangle> &triangles);
+
+class mapped_file /* 只读内存映射 */
+{
+public:
+    mapped_file() {}
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    // Maps the whole file read-only and hints that access will be random (no readahead).
+    bool open(const std::string &filename);
+    void close();
+
+    const unsigned char *data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char *base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr;
+#endif
+};
+
+class mapped_mesh : public hittable
+{
+public:
+    // Maps `filename`; an unreadable or malformed file reports an error and yields an empty mesh.
+    // Only the header is checked up front. Node records are bounds-checked as traversal reads
+    // them, so a corrupt node array makes rays miss instead of reading outside the mapping.
+    mapped_mesh(const std::string &filename, shared_ptr<material> mat);
+
+    bool valid() const { return nodes != nullptr; }
+    size_t triangle_count() const { return triangles_in_file; }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (!valid())
+            return false;
+
+        // Iterative traversal over the mapped nodes, nearer child first.
+        double inv[3] = {1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z()};
+        std::uint32_t stack[64];
+        int top = 0;
+        std::uint32_t index = 0;
+        const mesh_file_triangle *closest = nullptr;
+        double closest_u = 0, closest_v = 0;
+        for (;;)
+        {
+            RT_STAT(bvh_nodes_visited);
+            if (index >= nodes_in_file)
+                return false; // Child index past the node array: the file is corrupt
+            const auto &node = nodes[index];
+            if (box_hit(node, r, inv, ray_t))
+            {
+                if (node.count > 0)
+                {
+                    if (std::uint64_t(node.offset) + node.count > triangles_in_file)
+                        return false;
+                    for (std::uint32_t k = 0; k < node.count; k++)
+                    {
+                        const auto &tri = triangles[node.offset + k];
+                        double t, u, v;
+                        if (triangle_hit(tri, r, ray_t, t, u, v))
+                        {
+                            ray_t.max = t;
+                            closest = &tri;
+                            closest_u = u, closest_v = v;
+                        }
+                    }
+                }
+                else
+                {
+                    // Right children always lie past their parent, so indices only grow and a
+                    // bad file can at worst run off the end, which the checks above catch.
+                    if (node.offset < 2 || node.axis > 2 || top == 64)
+                        return false;
+                    auto near_child = index + 1, far_child = index + node.offset;
+                    if (inv[node.axis] < 0)
+                        std::swap(near_child, far_child);
+                    stack[top++] = far_child;
+                    index = near_child;
+                    continue;
+                }
+            }
+            if (top == 0)
+                break;
+            index = stack[--top];
+        }
+
+        if (!closest)
+            return false;
+        RT_STAT(primitive_hits[stat_triangle]);
+        rec.t = ray_t.max;
+        rec.p = r.at(rec.t);
+        rec.set_face_normal(r, vec3(closest->normal[0], closest->normal[1], closest->normal[2]));
+        rec.u = closest_u; // Barycentric coordinates of the hit
+        rec.v = closest_v;
+        rec.dpdu = vec3(closest->e1[0], closest->e1[1], closest->e1[2]).length();
+        rec.dpdv = vec3(closest->e2[0], closest->e2[1], closest->e2[2]).length();
+        rec.mat = mat;
+        rec.object = this;
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+    shared_ptr<material> surface_material() const override { return mat; }
+
+private:
+    mapped_file file;
+    const mesh_file_node *nodes = nullptr;
+    const mesh_file_triangle *triangles = nullptr;
+    size_t nodes_in_file = 0, triangles_in_file = 0;
+    shared_ptr<material> mat;
+    aabb bbox = aabb::empty;
+
+    static bool box_hit(const mesh_file_node &node, const ray &r, const double inv[3], const interval &ray_t)
+    {
+        RT_STAT(box_tests);
+        auto t_min = ray_t.min, t_max = ray_t.max;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            auto t0 = (node.bounds_min[axis] - r.origin()[axis]) * inv[axis];
+            auto t1 = (node.bounds_max[axis] - r.origin()[axis]) * inv[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max <= t_min)
+                return false;
+        }
+        return true;
+    }
+
+    static bool triangle_hit(const mesh_file_triangle &tri, const ray &r, const interval &ray_t, double &t, double &u, double &v)
+    {
+        // Moller-Trumbore; both faces count as hits.
+        RT_STAT(primitive_tests[stat_triangle]);
+        vec3 e1(tri.e1[0], tri.e1[1], tri.e1[2]), e2(tri.e2[0], tri.e2[1], tri.e2[2]);
+        auto p = cross(r.direction(), e2);
+        auto det = dot(e1, p);
+        if (std::fabs(det) < 1e-12)
+            return false;
+        auto inv_det = 1 / det;
+        auto s = r.origin() - point3(tri.v0[0], tri.v0[1], tri.v0[2]);
+        u = dot(s, p) * inv_det;
+        if (u < 0 || u > 1)
+            return false;
+        auto q = cross(s, e1);
+        v = dot(r.direction(), q) * inv_det;
+        if (v < 0 || u + v > 1)
+            return false;
+        t = dot(e2, q) * inv_det;
+        return ray_t.surrounds(t);
+    }
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "../tool/arena.h"
 
 class quad : public hittable
 {
@@ -15,6 +16,8 @@ public:
         D = dot(normal, Q);
         w = n / dot(n, n);
         area = n.length();
+        u_length = u.length();
+        v_length = v.length();
 
         set_bounding_box();
     }
@@ -28,9 +31,11 @@ public:
     }
 
     aabb bounding_box() const override { return bbox; }
+    shared_ptr<material> surface_material() const override { return mat; }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
+        RT_STAT(primitive_tests[stat_quad]);
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane.
@@ -53,8 +58,12 @@ public:
 
         rec.t = t;
         rec.p = intersection;
+        rec.dpdu = u_length;
+        rec.dpdv = v_length;
         rec.mat = mat;
+        rec.object = this;
         rec.set_face_normal(r, normal);
+        RT_STAT(primitive_hits[stat_quad]);
 
         return true;
     }
@@ -78,6 +87,14 @@ public:
         hit_record rec;
         if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec)) /* 没有击中光源，返回0 */
             return 0;
+
+        return hit_pdf_value(origin, direction, rec);
+    }
+
+    double hit_pdf_value(const point3 &origin, const vec3 &direction, const hit_record &rec) const override
+    {
+        if (rec.object != this)
+            return 0;
         /* 否则返回：p(direction) = distance(p,q)^2 / (cosα * A) */
         auto distance_squared = rec.t * rec.t * direction.length_squared();
         auto cosine = std::fabs(dot(direction, rec.normal) / direction.length());
@@ -91,6 +108,18 @@ public:
         return p - origin;
     }
 
+    double sample_surface(hit_record &rec) const override
+    {
+        rec.u = random_double();
+        rec.v = random_double();
+        rec.p = Q + (rec.u * u) + (rec.v * v);
+        rec.normal = normal;
+        rec.front_face = true;
+        rec.mat = mat;
+        rec.object = this;
+        return area;
+    }
+
 private:
     point3 Q;  /* 起始点 */
     vec3 u, v; /* 平面上边向量 */
@@ -100,12 +129,16 @@ private:
     vec3 normal;              /* 法线 */
     double D;
     double area; /* 光源面积 */
+    double u_length, v_length; /* 纹理坐标的世界尺度 */
 };
-inline shared_ptr<hittable_list> box(const point3 &a, const point3 &b, shared_ptr<material> mat)
+inline shared_ptr<hittable_list> box(const point3 &a, const point3 &b, shared_ptr<material> mat, scene_arena *arena = nullptr)
 {
-    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
+    // Returns the 3D box (six sides) that contains the two opposite vertices a & b. With an
+    // arena the list and its sides are placed there.
 
-    auto sides = make_shared<hittable_list>();
+    auto sides = arena ? arena->make<hittable_list>() : make_shared<hittable_list>();
+    auto side = [&](const point3 &Q, const vec3 &u, const vec3 &v)
+    { sides->add(arena ? arena->make<quad>(Q, u, v, mat) : make_shared<quad>(Q, u, v, mat)); };
 
     // Construct the two opposite vertices with the minimum and maximum coordinates.
     auto min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
@@ -115,12 +148,12 @@ inline shared_ptr<hittable_list> box(const point3 &a, const point3 &b, shared_pt
     auto dy = vec3(0, max.y() - min.y(), 0);
     auto dz = vec3(0, 0, max.z() - min.z());
 
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat));  // front
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat)); // right
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat)); // back
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat));  // left
-    sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat)); // top
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat));  // bottom
+    side(point3(min.x(), min.y(), max.z()), dx, dy);  // front
+    side(point3(max.x(), min.y(), max.z()), -dz, dy); // right
+    side(point3(max.x(), min.y(), min.z()), -dx, dy); // back
+    side(point3(min.x(), min.y(), min.z()), dz, dy);  // left
+    side(point3(min.x(), max.y(), max.z()), dx, -dz); // top
+    side(point3(min.x(), min.y(), min.z()), dx, dz);  // bottom
 
     return sides;
 }
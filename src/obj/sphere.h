@@ -26,6 +26,7 @@ public:
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
         /* 是否有交点 */
+        RT_STAT(primitive_tests[stat_sphere]);
 
         point3 current_center = vray.at(r.time()); /* 新的物体位置 */
         vec3 oc = current_center - r.origin();
@@ -56,11 +57,36 @@ public:
         outward_normal = (rec.p - current_center) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.dpdu = 2 * pi * radius * std::sqrt(std::max(0.0, 1 - outward_normal.y() * outward_normal.y())); /* 纬线周长 */
+        rec.dpdv = pi * radius;
         rec.mat = mat;
+        rec.object = this;
+        RT_STAT(primitive_hits[stat_sphere]);
 
         return true;
     }
     aabb bounding_box() const override { return bbox; }
+    shared_ptr<material> surface_material() const override { return mat; }
+    unsigned features() const override
+    {
+        return hittable::features() | (vray.direction().length_squared() > 0 ? unsigned(feature_motion_blur) : 0u);
+    }
+    void set_center(const point3 &center) /* 动画：移动静止的球体 */
+    {
+        set_center(center, center);
+    }
+    void set_center(const point3 &center1, const point3 &center2)
+    {
+        vray = ray(center1, center2 - center1);
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(aabb(center1 - rvec, center1 + rvec), aabb(center2 - rvec, center2 + rvec));
+    }
+    aabb bounding_box_at(double time) const override /* 某一时刻球体的包围盒 */
+    {
+        auto rvec = vec3(radius, radius, radius);
+        auto center = vray.at(time);
+        return aabb(center - rvec, center + rvec);
+    }
     static void get_sphere_uv(const point3 &p, double &u, double &v) /* 从p交点-》极坐标-》uv对应值 */
     {
         // p: a given point on the sphere of radius one, centered at the origin.
@@ -84,6 +110,14 @@ public:
         if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
             return 0;
 
+        return hit_pdf_value(origin, direction, rec);
+    }
+
+    double hit_pdf_value(const point3 &origin, const vec3 &direction, const hit_record &rec) const override
+    {
+        if (rec.object != this)
+            return 0;
+
         auto dist_squared = (vray.at(0) - origin).length_squared();
         auto cos_theta_max = std::sqrt(1 - radius * radius / dist_squared);
         auto solid_angle = 2 * pi * (1 - cos_theta_max);
@@ -91,6 +125,18 @@ public:
         return 1 / solid_angle;
     }
 
+    double sample_surface(hit_record &rec) const override
+    {
+        auto outward_normal = random_unit_vector();
+        rec.p = vray.at(0) + radius * outward_normal;
+        rec.normal = outward_normal;
+        rec.front_face = true;
+        get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.mat = mat;
+        rec.object = this;
+        return 4 * pi * radius * radius;
+    }
+
     vec3 random(const point3 &origin) const override
     {
         vec3 direction = vray.at(0) - origin;
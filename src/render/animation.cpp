@@ -0,0 +1 @@
+#include "animation.h"
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "camera.h"
+#include "../obj/hittable.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* 动画：每帧更新物体和相机，然后refit加速结构并渲染 */
+class animation
+{
+public:
+    using update_fn = std::function<void(double time)>; // time in seconds since the first frame
+
+    double frames_per_second = 24;
+    int frame_count = 240;
+
+    void add(update_fn update) { updates.push_back(update); }
+
+    void render(camera &cam, hittable &world, hittable &lights, const std::string &filename_prefix)
+    {
+        // Each frame moves the scene in place and refits the existing acceleration structure
+        // instead of rebuilding it; frames are written as <prefix>_0000.ppm, <prefix>_0001.ppm, ...
+        double setup_seconds = 0;
+        double render_seconds = 0;
+
+        for (int frame = 0; frame < frame_count; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            auto time = frame / frames_per_second;
+            for (const auto &update : updates)
+                update(time);
+            world.refit();
+            lights.refit();
+
+            auto updated = std::chrono::steady_clock::now();
+
+            std::ofstream out(frame_filename(filename_prefix, frame));
+            cam.render(world, lights, out);
+
+            auto done = std::chrono::steady_clock::now();
+            setup_seconds += std::chrono::duration<double>(updated - start).count();
+            render_seconds += std::chrono::duration<double>(done - updated).count();
+
+            std::clog << "Frame " << frame + 1 << '/' << frame_count << " done.\n";
+        }
+
+        std::clog << "Scene update + refit: " << setup_seconds << "s, rendering: " << render_seconds << "s\n";
+    }
+
+private:
+    std::vector<update_fn> updates;
+
+    static std::string frame_filename(const std::string &prefix, int frame)
+    {
+        char number[16];
+        std::snprintf(number, sizeof(number), "_%04d.ppm", frame);
+        return prefix + number;
+    }
+};
+
+#endif
@@ -6,7 +6,22 @@
 #include "../tool/PDF.h"
 #include "../render/ray.h"
 #include "../render/material.h"
+#include "../render/shading_table.h"
+#include "../render/photon_map.h"
+#include "../render/path_guide.h"
+#include "../render/environment.h"
 #include "../tool/interval.h"
+#include "../tool/stats.h"
+#include "../tool/trace.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef RT_ENABLE_STATS
+#include <fstream>
+#endif
 class camera
 {
 public:
@@ -15,7 +30,9 @@ public:
     int image_width = 100;      // Rendered image width in pixel count
     int samples_per_pixel = 10; // Count of random samples for each pixel
     int max_depth = 10;         // Maximum number of ray bounces into scene
-    color background;           // Scene background color
+    color background;           // Scene background color, when there is no environment map
+    const environment_light *environment = nullptr; // When set, rays leaving the scene see this map
+    double environment_share = 0.5; // Share of the light samples drawn from the environment
 
     /* camera */
     double vfov = 90;                  // Vertical view angle (field of view)
@@ -25,46 +42,177 @@ public:
                                        /* 景深 */
     double defocus_angle = 0;          // Variation angle of rays through each pixel
     double focus_dist = 10;            // Distance from camera lookfrom point to plane of perfect focus
+                                       /* 并行 */
+    int tile_size = 16;                // Edge length of the square tiles handed to worker threads
+    int thread_count = 0;              // Worker threads, 0 = one per hardware thread
+    unsigned int seed = 0;             // Seed of this render; each tile derives its own sequence from it
+    int tile_share = 0;                // Render only the tiles t with t % tile_share_count == tile_share,
+    int tile_share_count = 1;          // the share of one process in a distributed render
+    const std::atomic<bool> *cancel = nullptr; // When set, tiles not yet started are skipped
+    bool show_progress = true;         // Print the tiles remaining to std::clog
+    std::atomic<int> *tiles_done = nullptr; // When set, counts the tiles finished, e.g. for a worker's heartbeat
+    const shading_table *shading = nullptr; // Closed-world materials; null shades through virtual calls
+    unsigned features = feature_all;   // scene_feature bits the world uses (world.features()); defocus comes from defocus_angle
+    const photon_map *caustics = nullptr; // When set, caustics come from these photons instead of from paths
+    path_guide *guide = nullptr;       // When set, also sample learned directions; renders record while it learns
     void render(const hittable &world, const hittable &lights)
+    {
+        render(world, lights, std::cout);
+    }
+
+    void render(const hittable &world, const hittable &lights, std::ostream &out)
     {
         initialize();
 
-        std::cout << "P3\n"
-                  << image_width << ' ' << image_height << "\n255\n";
+        std::vector<color> pixels;
+        render_image(world, lights, pixels);
+        write_image(out, pixels);
 
-        for (int j = 0; j < image_height; j++)
-        {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; i++)
-            {
-                color pixel_color(0, 0, 0);
-                for (int s_j = 0; s_j < sqrt_spp; s_j++)
-                {
-                    for (int s_i = 0; s_i < sqrt_spp; s_i++)
+        std::clog << "\rDone.                 \n";
+
+#ifdef RT_ENABLE_STATS
+        auto stats = render_stats::collect();
+        stats.print(std::clog);
+        std::ofstream json("render_stats.json");
+        stats.write_json(json);
+        render_stats::reset();
+#endif
+    }
+
+    void write_image(std::ostream &out, const std::vector<color> &pixels) const
+    {
+        RT_TRACE_SCOPE("output encode");
+        out << "P3\n"
+            << image_width << ' ' << image_height << "\n255\n";
+        for (const auto &pixel : pixels)
+            write_color(out, pixel);
+    }
+
+    void render_image(const hittable &world, const hittable &lights, std::vector<color> &pixels) const
+    {
+        // Renders every pixel into `pixels` (row by row); initialize() must have run. Pixels of
+        // tiles outside this camera's tile share stay black. A guide that is still learning
+        // records this pass and updates its tables afterwards.
+        RT_TRACE_SCOPE("render");
+        pixels.assign(size_t(image_width) * image_height, color(0, 0, 0));
+        for_each_tile([&](int x0, int y0, int x1, int y1)
+                      {
+            for (int j = y0; j < y1; j++)
+                for (int i = x0; i < x1; i++)
+                    pixels[size_t(j) * image_width + i] = render_pixel(i, j, world, lights); });
+        if (guide && guide->learning() && !(cancel && cancel->load()))
+            guide->finish_pass();
+    }
+
+    void for_each_tile(const std::function<void(int x0, int y0, int x1, int y1)> &render_tile) const
+    {
+        // Cuts the image into tiles that worker threads take from a shared counter and calls
+        // render_tile for the pixel range [x0,x1) x [y0,y1) of each. Every tile reseeds the
+        // thread's generator from (seed, tile index), so the result does not depend on the number
+        // of threads or on which thread rendered which tile, nor on how the tiles were shared out
+        // between processes.
+        auto share = share_tiles();
+        int tiles = int(share.size());
+        run_workers(thread_count, tiles, [&](int k, bool report_progress)
                     {
-                        ray r = get_ray(i, j, s_i, s_j);
-                        pixel_color += ray_color(r, max_depth, world, lights);
-                    }
-                }
-                write_color(std::cout, pixel_samples_scale * pixel_color);
-            }
+            if (cancel && cancel->load(std::memory_order_relaxed))
+                return false;
+            if (report_progress && show_progress)
+                std::clog << "\rTiles remaining: " << (tiles - k) << "    " << std::flush;
+
+            int t = share[k], x0, y0, x1, y1;
+            tile_bounds(t, x0, y0, x1, y1);
+            RT_STAT_TILE(x0, y0);
+            RT_TRACE_SCOPE("tile", x0, y0);
+            seed_random(tile_seed(t));
+            if (guide)
+                guide->begin_tile(t);
+            render_tile(x0, y0, x1, y1);
+            if (guide)
+                guide->end_tile();
+            if (tiles_done)
+                tiles_done->fetch_add(1, std::memory_order_relaxed);
+            return true; });
+    }
+
+    static void render_views(const std::vector<camera> &views, const hittable &world, const hittable &lights,
+                             std::vector<std::vector<color>> &images)
+    {
+        // Renders several initialized views of one scene into images[v]. The tiles of all views
+        // go through one shared queue, so threads move on to the next view while the last tiles
+        // of a view are still being rendered instead of idling at the end of every image. Each
+        // image is identical to the view's own render_image(). The thread count is views[0]'s.
+        RT_TRACE_SCOPE("render");
+        std::vector<std::pair<int, int>> queue; /* (视图, tile) */
+        images.resize(views.size());
+        for (int v = 0; v < int(views.size()); v++)
+        {
+            images[v].assign(size_t(views[v].image_width) * views[v].image_height, color(0, 0, 0));
+            for (int t : views[v].share_tiles())
+                queue.emplace_back(v, t);
         }
+        if (queue.empty())
+            return;
 
-        std::clog << "\rDone.                 \n";
+        int count = int(queue.size());
+        run_workers(views[0].thread_count, count, [&](int k, bool report_progress)
+                    {
+            const auto &cam = views[queue[k].first];
+            auto &pixels = images[queue[k].first];
+            if (cam.cancel && cam.cancel->load(std::memory_order_relaxed))
+                return true; // Only this view stops
+            if (report_progress && cam.show_progress)
+                std::clog << "\rTiles remaining: " << (count - k) << "    " << std::flush;
+
+            int t = queue[k].second, x0, y0, x1, y1;
+            cam.tile_bounds(t, x0, y0, x1, y1);
+            RT_STAT_TILE(x0, y0);
+            RT_TRACE_SCOPE("tile", x0, y0);
+            seed_random(cam.tile_seed(t));
+            if (cam.guide)
+                cam.guide->begin_tile(k);
+            for (int j = y0; j < y1; j++)
+                for (int i = x0; i < x1; i++)
+                    pixels[size_t(j) * cam.image_width + i] = cam.render_pixel(i, j, world, lights);
+            if (cam.guide)
+                cam.guide->end_tile();
+            return true; });
     }
 
-private:
-    int image_height;           // Rendered image height
-    double pixel_samples_scale; // Color scale factor for a sum of pixel samples每个采样点的权重
-    int sqrt_spp;               // Square root of number of samples per pixel每像素分层采样样本数的平方根
-    double recip_sqrt_spp;      // 1 / sqrt_spp分层采样的权重
-    point3 center;              // Camera center
-    point3 pixel00_loc;         // Location of pixel 0, 0
-    vec3 pixel_delta_u;         // Offset to pixel to the right
-    vec3 pixel_delta_v;         // Offset to pixel below
-    vec3 u, v, w;               // Camera frame basis vectors
-    vec3 defocus_disk_u;        // Defocus disk horizontal radius
-    vec3 defocus_disk_v;        // Defocus disk vertical radius
+    color render_pixel(int i, int j, const hittable &world, const hittable &lights) const
+    {
+        // Average of the stratified samples through pixel (i, j); initialize() must have run.
+        return (this->*render_pixel_for)(i, j, world, lights);
+    }
+
+    int tile_count() const
+    {
+        int tile = tile_size < 1 ? 1 : tile_size;
+        return ((image_width + tile - 1) / tile) * ((image_height + tile - 1) / tile);
+    }
+
+    void tile_bounds(int t, int &x0, int &y0, int &x1, int &y1) const /* 第t个tile的像素范围 */
+    {
+        int tile = tile_size < 1 ? 1 : tile_size;
+        int tiles_x = (image_width + tile - 1) / tile;
+        x0 = (t % tiles_x) * tile, y0 = (t / tiles_x) * tile;
+        x1 = std::min(x0 + tile, image_width), y1 = std::min(y0 + tile, image_height);
+    }
+
+    std::vector<int> share_tiles() const
+    {
+        // Tiles of this camera's share in render order. Interleaving the tiles spreads cheap and
+        // expensive image regions evenly over the shares.
+        std::vector<int> tiles;
+        int shares = std::max(1, tile_share_count);
+        for (int t = tile_share; t < tile_count(); t += shares)
+            tiles.push_back(t);
+        return tiles;
+    }
+
+    int height() const { return image_height; }                       /* initialize()之后有效 */
+    int samples_taken_per_pixel() const { return sqrt_spp * sqrt_spp; } /* 分层后实际的样本数 */
+
     void initialize()
     {
         image_height = int(image_width / aspect_ratio);
@@ -95,6 +243,7 @@ private:
         // Calculate the horizontal and vertical delta vectors from pixel to pixel.
         pixel_delta_u = viewport_u / image_width; /* 每个像素大小 */
         pixel_delta_v = viewport_v / image_height;
+        pixel_spread = pixel_delta_u.length() / focal_length; /* 像素对应的光锥张角 */
 
         // Calculate the location of the upper left pixel.
         auto viewport_upper_left = center - (focal_length * w) - viewport_u / 2 - viewport_v / 2;
@@ -103,7 +252,92 @@ private:
         auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
         defocus_disk_u = u * defocus_radius;
         defocus_disk_v = v * defocus_radius;
+
+        auto used = (features & ~unsigned(feature_defocus)) | (defocus_angle > 0 ? unsigned(feature_defocus) : 0u);
+        render_pixel_for = select_integrator(used & integrator_features, std::make_index_sequence<integrator_features + 1>());
+    }
+
+private:
+    int image_height;           // Rendered image height
+    double pixel_samples_scale; // Color scale factor for a sum of pixel samples每个采样点的权重
+    int sqrt_spp;               // Square root of number of samples per pixel每像素分层采样样本数的平方根
+    double recip_sqrt_spp;      // 1 / sqrt_spp分层采样的权重
+    point3 center;              // Camera center
+    point3 pixel00_loc;         // Location of pixel 0, 0
+    vec3 pixel_delta_u;         // Offset to pixel to the right
+    vec3 pixel_delta_v;         // Offset to pixel below
+    double pixel_spread;        // Angle subtended by one pixel, the spread of camera ray cones
+    vec3 u, v, w;               // Camera frame basis vectors
+    vec3 defocus_disk_u;        // Defocus disk horizontal radius
+    vec3 defocus_disk_v;        // Defocus disk vertical radius
+
+    /* 按特性专门化的积分器 */
+    // The integrator is compiled once for every combination of the features it branches on, and
+    // initialize() picks the one for the scene: a scene without motion blur draws no ray times,
+    // one without emitters never asks materials for emission, one without specular materials has
+    // no mirror branch. The other scene_feature bits are only reported. They are the low bits of
+    // scene_feature, so a feature mask is directly an index into the table of instantiations.
+    static constexpr unsigned integrator_features = feature_motion_blur | feature_defocus | feature_emitters | feature_specular;
+    using pixel_function = color (camera::*)(int, int, const hittable &, const hittable &) const;
+    pixel_function render_pixel_for = &camera::render_pixel_as<integrator_features>;
+
+    template <size_t... F>
+    static pixel_function select_integrator(unsigned used, std::index_sequence<F...>)
+    {
+        static const pixel_function table[] = {&camera::render_pixel_as<unsigned(F)>...};
+        return table[used];
+    }
+
+    template <unsigned F>
+    color render_pixel_as(int i, int j, const hittable &world, const hittable &lights) const
+    {
+        color pixel_color(0, 0, 0);
+        for (int s_j = 0; s_j < sqrt_spp; s_j++)
+        {
+            for (int s_i = 0; s_i < sqrt_spp; s_i++)
+            {
+                ray r = get_ray<F>(i, j, s_i, s_j);
+                RT_STAT(camera_rays);
+                pixel_color += ray_color<F>(r, max_depth, world, lights);
+            }
+        }
+        return pixel_samples_scale * pixel_color;
+    }
+
+    static void run_workers(int thread_count, int items, const std::function<bool(int item, bool report_progress)> &work)
+    {
+        // Threads take items [0, items) from a shared counter until they run out or work()
+        // returns false. The calling thread works too and is the only one that reports progress.
+        std::atomic<int> next_item(0);
+        auto worker = [&](bool report_progress)
+        {
+            for (int k = next_item++; k < items; k = next_item++)
+                if (!work(k, report_progress))
+                    break;
+        };
+
+        int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+        threads = std::max(1, std::min(threads, items));
+        std::vector<std::thread> workers;
+        for (int k = 1; k < threads; k++)
+            workers.emplace_back(worker, false);
+        worker(true);
+        for (auto &w : workers)
+            w.join();
     }
+
+    unsigned int tile_seed(int tile) const
+    {
+        // Mix the render seed and the tile index (splitmix64 finalizer) so that neighbouring tiles
+        // and consecutive seeds start from unrelated generator states.
+        unsigned long long z = (unsigned long long)seed << 32 | (unsigned int)tile;
+        z += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return (unsigned int)(z ^ (z >> 31));
+    }
+
+    template <unsigned F>
     ray get_ray(int i, int j, int s_i, int s_j) const
     {
         // Construct a camera ray originating from the defocus disk and directed at a randomly
@@ -112,11 +346,13 @@ private:
         auto offset = sample_square_stratified(s_i, s_j);
         auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v); /* 偏移后的坐标 */
 
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        auto ray_origin = (F & feature_defocus) ? defocus_disk_sample() : center;
         auto ray_direction = pixel_sample - ray_origin;
-        auto ray_time = random_double();
+        auto ray_time = (F & feature_motion_blur) ? random_double() : 0.0; // Only moving objects look at the time
 
-        return ray(ray_origin, ray_direction, ray_time); /* 创建光线返回 */
+        ray r(ray_origin, ray_direction, ray_time); /* 创建光线返回 */
+        r.set_cone(0, pixel_spread);
+        return r;
     }
     vec3 sample_square_stratified(int s_i, int s_j) const
     {
@@ -141,24 +377,66 @@ private:
         auto p = random_in_unit_disk();
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
-    color ray_color(const ray &r, int depth, const hittable &world, const hittable &lights)
+    // Where a path is with respect to caustics. The photon map is read at the first diffuse
+    // surface of a path, so light reaching that surface over specular bounces from an emitter
+    // that shot photons must not be counted again when the path finds it. Deeper surfaces are
+    // path traced as usual.
+    enum path_state
+    {
+        eye_path,      // Only specular bounces since the camera, or caustics are off
+        after_diffuse, // Just left the first diffuse surface
+        caustic_tail,  // The first diffuse surface, then one or more specular bounces
+        indirect       // Past a second diffuse surface
+    };
+
+    color escaped(const ray &r) const
+    {
+        // Light arriving along a ray that leaves the scene.
+        return environment ? environment->radiance(r.direction()) : background;
+    }
+
+    template <unsigned F>
+    color ray_color(const ray &r, int depth, const hittable &world, const hittable &lights, path_state state = eye_path)
         const
     {
         // If we've exceeded the ray bounce limit, no more light is gathered.
         if (depth <= 0)
+        {
+            RT_STAT(max_depth_terminations);
+            RT_STAT_PATH(max_depth);
             return color(0, 0, 0);
+        }
 
         hit_record rec;
 
         // If the ray hits nothing, return the background color.
         if (!world.hit(r, interval(0.001, infinity), rec))
-            return background;
+        {
+            RT_STAT(ray_misses);
+            RT_STAT_PATH(max_depth - depth);
+            return escaped(r);
+        }
+        RT_STAT(ray_hits);
+        rec.footprint = r.footprint(rec.t);
 
+        return ray_color<F>(r, rec, depth, world, lights, state);
+    }
+    template <unsigned F>
+    color ray_color(const ray &r, const hit_record &rec, int depth, const hittable &world, const hittable &lights,
+                    path_state state = eye_path) const
+    {
+        // Shade a ray whose closest hit `rec` is already known.
         scatter_record srec;
-        color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+        color color_from_emission(0, 0, 0);
+        if constexpr ((F & feature_emitters) != 0)
+            if (state != caustic_tail || !caustics->shot_from(rec.object))
+                color_from_emission = shading ? shading->emitted(r, rec) : rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
 
-        if (!rec.mat->scatter(r, rec, srec))
+        if (!(shading ? shading->scatter(r, rec, srec) : rec.mat->scatter(r, rec, srec)))
+        {
+            RT_STAT_PATH(max_depth - depth);
             return color_from_emission;
+        }
 
         ///* 非混合 */
         // cosine_pdf surface_pdf(rec.normal);
@@ -168,19 +446,121 @@ private:
         // hittable_pdf light_pdf(lights, rec.p);
         // scattered = ray(rec.p, light_pdf.generate(), r.time());
         // pdf_value = light_pdf.value(scattered.direction());
-        if (srec.skip_pdf) {
-            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
+        if constexpr ((F & feature_specular) != 0)
+            if (srec.skip_pdf) {
+                if (depth - 1 > 0)
+                    RT_STAT(specular_rays);
+                srec.skip_pdf_ray.set_cone(rec.footprint, r.cone_spread());
+                return srec.attenuation * ray_color<F>(srec.skip_pdf_ray, depth-1, world, lights,
+                                                       state == after_diffuse ? caustic_tail : state);
+            }
+
+        // Caustics arrive through the photon map at the first diffuse surface. Media scatter
+        // inside volumes, where the surface estimate does not apply; their paths keep all their light.
+        auto next_state = state == eye_path ? eye_path : indirect;
+        if (caustics && state == eye_path && !(rec.mat->features() & feature_media))
+        {
+            color_from_emission += caustics->estimate(rec.p, rec.normal, [&](const vec3 &wi)
+                                                      {
+                auto cos_theta = dot(rec.normal, wi);
+                auto pdf = shading ? shading->scattering_pdf(r, rec, ray(rec.p, wi, r.time()))
+                                   : rec.mat->scattering_pdf(r, rec, ray(rec.p, wi, r.time()));
+                return srec.attenuation * (pdf / cos_theta); });
+            next_state = after_diffuse;
+        }
+        if (depth - 1 <= 0)
+        {
+            RT_STAT(max_depth_terminations);
+            RT_STAT_PATH(max_depth);
+            return color_from_emission;
+        }
+
+        // A mixture of the light pdf and the surface pdf, evaluated inline. With a path guide the
+        // learned distribution of the region takes its share, and the other two split the rest.
+        // An environment map takes environment_share of the light samples.
+        hittable_pdf light_pdf(lights, rec.p);
+        int guide_cell = guide ? guide->cell(rec.p, rec.normal) : 0;
+        double guide_weight = guide ? guide->weight(guide_cell) : 0.0;
+        double light_weight = 0.5 * (1 - guide_weight);
+        double environment_weight = environment ? light_weight * environment_share : 0.0;
+
+        const hittable *sampled_light = nullptr;
+        auto strategy = random_double();
+        bool from_environment = strategy < environment_weight;
+        bool from_light = !from_environment && strategy < light_weight;
+        ray scattered = ray(rec.p, from_environment ? environment->sample()
+                                   : from_light ? light_pdf.generate(sampled_light)
+                                   : strategy < 2 * light_weight ? srec.generate()
+                                                                 : guide->sample(guide_cell),
+                            r.time());
+        // Secondary cones start as wide as the footprint here and keep the parent's spread. That
+        // ignores the widening from curvature and rough lobes, so it errs towards too little blur.
+        scattered.set_cone(rec.footprint, r.cone_spread());
+
+        // A direction the surface does not scatter into (a light or guide sample below it)
+        // contributes nothing; do not trace it.
+        double scattering_pdf = shading ? shading->scattering_pdf(r, rec, scattered)
+                                        : rec.mat->scattering_pdf(r, rec, scattered); /* costheta / PI */
+        if (scattering_pdf <= 0)
+        {
+            RT_STAT_PATH(max_depth - depth + 1);
+            return color_from_emission;
         }
-        auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
-        auto pdf_value = p.value(scattered.direction());
+        // Trace the scattered ray once and take the light pdf from whatever it hit, instead of
+        // re-intersecting every light in hittable_pdf::value and then tracing the world again.
+        // Using only the first-hit light keeps the estimate unbiased as a one-sample MIS: a light
+        // sample counts only if it actually reaches the light it was drawn from, and the weights of
+        // the two strategies still sum to one for every direction.
+        // Light and environment samples cross grid media and take their transmittance along
+        // (media_pass); the BSDF and guide samples still scatter in them, so together they cover
+        // both the light that passes and the light scattered in the medium.
+        hit_record scattered_rec;
+        bool scattered_hit;
+        double transmittance = 1.0;
+        if ((features & feature_media) && (from_light || from_environment))
+        {
+            media_pass pass;
+            scattered_hit = world.hit(scattered, interval(0.001, infinity), scattered_rec);
+            transmittance = pass.transmittance(interval(0.001, scattered_hit ? scattered_rec.t : infinity));
+        }
+        else
+            scattered_hit = world.hit(scattered, interval(0.001, infinity), scattered_rec);
+        RT_STAT(scatter_rays);
+        if (scattered_hit)
+        {
+            RT_STAT(ray_hits);
+            scattered_rec.footprint = scattered.footprint(scattered_rec.t);
+        }
+        else
+            RT_STAT(ray_misses);
+        if ((from_light && (!scattered_hit || scattered_rec.object != sampled_light)) ||
+            (from_environment && scattered_hit))
+        {
+            RT_STAT_PATH(max_depth - depth + 1);
+            return color_from_emission;
+        }
 
-        /* …… */
+        // Like the surface lights, the environment counts only where the ray actually escapes.
+        auto light_pdf_value = scattered_hit ? light_pdf.value(scattered.direction(), scattered_rec) : 0.0;
+        auto pdf_value = (light_weight - environment_weight) * light_pdf_value +
+                         light_weight * srec.pdf_value(scattered.direction());
+        if (environment_weight > 0 && !scattered_hit)
+            pdf_value += environment_weight * environment->pdf(scattered.direction());
+        if (guide_weight > 0)
+            pdf_value += guide_weight * guide->pdf(guide_cell, scattered.direction());
+        if (pdf_value <= 0 || transmittance <= 0)
+        {
+            RT_STAT_PATH(max_depth - depth + 1);
+            return color_from_emission;
+        }
 
-        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered); /* costheta / PI */
-        color sample_color = ray_color(scattered, depth - 1, world, lights);
+        if (!scattered_hit)
+            RT_STAT_PATH(max_depth - depth + 1);
+        color sample_color = transmittance * (scattered_hit ? ray_color<F>(scattered, scattered_rec, depth - 1, world, lights, next_state)
+                                                            : escaped(scattered));
+        if (guide && guide->learning())
+            guide->record(guide_cell, scattered.direction(), (sample_color.x() + sample_color.y() + sample_color.z()) / (3 * pdf_value));
         color color_from_scatter =
             (srec.attenuation * scattering_pdf * sample_color) / pdf_value;
 
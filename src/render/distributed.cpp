@@ -0,0 +1,313 @@
+#include "distributed.h"
+#include "../tool/trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static const char share_magic[8] = "RTSHARE";
+
+static share_file_header expected_header(const camera &cam, int share, int share_count)
+{
+    share_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, share_magic, sizeof(header.magic));
+    header.width = std::uint32_t(cam.image_width);
+    header.height = std::uint32_t(cam.height());
+    header.share = std::uint32_t(share);
+    header.share_count = std::uint32_t(share_count);
+    header.tile_size = std::uint32_t(cam.tile_size);
+    header.samples = std::uint32_t(cam.samples_taken_per_pixel());
+    header.seed = cam.seed;
+    return header;
+}
+
+static camera share_camera(const camera &cam, int share, int share_count)
+{
+    auto c = cam;
+    c.tile_share = share;
+    c.tile_share_count = share_count;
+    return c;
+}
+
+bool write_share(const std::string &filename, const camera &cam, const std::vector<color> &pixels)
+{
+    RT_TRACE_SCOPE("output encode");
+    auto header = expected_header(cam, cam.tile_share, cam.tile_share_count);
+    auto partial = filename + ".part";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (int t : cam.share_tiles())
+        {
+            int x0, y0, x1, y1;
+            cam.tile_bounds(t, x0, y0, x1, y1);
+            for (int j = y0; j < y1; j++)
+                for (int i = x0; i < x1; i++)
+                {
+                    const auto &c = pixels[size_t(j) * cam.image_width + i];
+                    double rgb[3] = {c.x(), c.y(), c.z()};
+                    out.write(reinterpret_cast<const char *>(rgb), sizeof(rgb));
+                }
+        }
+        if (!out.flush())
+            return false;
+    }
+    // Publish by renaming, so a reader never sees a half-written share.
+    std::remove(filename.c_str());
+    return std::rename(partial.c_str(), filename.c_str()) == 0;
+}
+
+bool read_share(const std::string &filename, const camera &cam, int share, int share_count, std::vector<color> &pixels)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        return false;
+    share_file_header header;
+    auto expected = expected_header(cam, share, share_count);
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+
+    // Read into a scratch frame first so a truncated file leaves `pixels` untouched.
+    auto c = share_camera(cam, share, share_count);
+    std::vector<std::pair<size_t, color>> tiles;
+    for (int t : c.share_tiles())
+    {
+        int x0, y0, x1, y1;
+        c.tile_bounds(t, x0, y0, x1, y1);
+        for (int j = y0; j < y1; j++)
+            for (int i = x0; i < x1; i++)
+            {
+                double rgb[3];
+                if (!in.read(reinterpret_cast<char *>(rgb), sizeof(rgb)))
+                    return false;
+                tiles.emplace_back(size_t(j) * cam.image_width + i, color(rgb[0], rgb[1], rgb[2]));
+            }
+    }
+    if (in.peek() != std::ifstream::traits_type::eof())
+        return false;
+    for (const auto &pixel : tiles)
+        pixels[pixel.first] = pixel.second;
+    return true;
+}
+
+std::string heartbeat_filename(const std::string &share_filename)
+{
+    return share_filename + ".alive";
+}
+
+share_heartbeat::share_heartbeat(const std::string &share_filename) : filename(heartbeat_filename(share_filename))
+{
+    beater = std::thread([this]
+                         {
+        for (unsigned beat = 0; !stop.load(); beat++)
+        {
+            std::ofstream(filename, std::ios::trunc) << beat << ' ' << tiles.load() << '\n';
+            for (int k = 0; k < 10 && !stop.load(); k++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } });
+}
+
+share_heartbeat::~share_heartbeat()
+{
+    stop = true;
+    beater.join();
+    std::remove(filename.c_str());
+}
+
+namespace
+{
+    // A worker command run through the shell without blocking, so the coordinator can watch its
+    // heartbeat and kill it.
+    class worker_process
+    {
+    public:
+        bool start(const std::string &command)
+        {
+#ifdef _WIN32
+            // A job object takes the shell and everything it starts down together.
+            job = CreateJobObjectA(nullptr, nullptr);
+            STARTUPINFOA startup = {};
+            startup.cb = sizeof(startup);
+            PROCESS_INFORMATION info = {};
+            std::string line = "cmd /c " + command;
+            if (!job || !CreateProcessA(nullptr, &line[0], nullptr, nullptr, TRUE, CREATE_SUSPENDED, nullptr, nullptr,
+                                        &startup, &info))
+                return false;
+            AssignProcessToJobObject(job, info.hProcess);
+            ResumeThread(info.hThread);
+            CloseHandle(info.hThread);
+            process = info.hProcess;
+            return true;
+#else
+            // The shell leads a new process group, so a kill reaches everything it started.
+            pid = fork();
+            if (pid == 0)
+            {
+                setpgid(0, 0);
+                execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+                _exit(127);
+            }
+            if (pid > 0)
+                setpgid(pid, pid); // Also here, in case the kill comes before the child ran
+            return pid > 0;
+#endif
+        }
+
+        // True once the process has ended; `status` is then its exit status, or -1 if it died
+        // from a signal.
+        bool finished(int &status)
+        {
+#ifdef _WIN32
+            if (WaitForSingleObject(process, 0) != WAIT_OBJECT_0)
+                return false;
+            DWORD code = 0;
+            GetExitCodeProcess(process, &code);
+            status = int(code);
+            close();
+            return true;
+#else
+            int raw = 0;
+            if (waitpid(pid, &raw, WNOHANG) != pid)
+                return false;
+            status = WIFEXITED(raw) ? WEXITSTATUS(raw) : -1;
+            return true;
+#endif
+        }
+
+        void kill()
+        {
+#ifdef _WIN32
+            TerminateJobObject(job, 1);
+            WaitForSingleObject(process, INFINITE);
+            close();
+#else
+            ::kill(-pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE job = nullptr, process = nullptr;
+
+        void close()
+        {
+            CloseHandle(process);
+            CloseHandle(job);
+            process = job = nullptr;
+        }
+#else
+        pid_t pid = -1;
+#endif
+    };
+
+    std::string read_text(const std::string &filename)
+    {
+        std::ifstream in(filename);
+        std::ostringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+}
+
+std::string render_coordinator::share_filename(int share) const
+{
+    return directory + "/share_" + std::to_string(share) + "_of_" + std::to_string(workers) + ".rts";
+}
+
+bool render_coordinator::render(const camera &cam, std::vector<color> &pixels) const
+{
+    RT_TRACE_SCOPE("render");
+    pixels.assign(size_t(cam.image_width) * cam.height(), color(0, 0, 0));
+    std::vector<char> done(workers, 0);
+    std::mutex merge_mutex;
+
+    // One thread per share starts its worker and watches it; a failed or hung share is started
+    // again right away, through the next launcher, while the other shares keep running.
+    auto run_share = [&](int share)
+    {
+        auto filename = share_filename(share);
+        auto heartbeat = heartbeat_filename(filename);
+        for (int attempt = 0; attempt < max_attempts; attempt++)
+        {
+            std::remove(filename.c_str()); // A stale file must not pass for this render's share
+            std::remove(heartbeat.c_str());
+            std::string command;
+            if (!launchers.empty())
+                command = launchers[(share + attempt) % launchers.size()] + " ";
+            command += worker_command + " --share " + std::to_string(share) + "/" + std::to_string(workers) +
+                       " --share-file \"" + filename + "\"";
+
+            // Wait for the worker, timing its heartbeat on this clock: the file may live on another
+            // machine's disk, whose clock says nothing about ours.
+            int status = -1;
+            bool hung = false;
+            worker_process process;
+            if (process.start(command))
+            {
+                std::string last_beat;
+                auto last_change = std::chrono::steady_clock::now();
+                while (!process.finished(status))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                    auto beat = read_text(heartbeat);
+                    auto now = std::chrono::steady_clock::now();
+                    if (beat != last_beat)
+                        last_beat = beat, last_change = now;
+                    else if (now - last_change > std::chrono::seconds(heartbeat_timeout))
+                    {
+                        process.kill();
+                        status = -1;
+                        hung = true;
+                        break;
+                    }
+                }
+            }
+            std::remove(heartbeat.c_str());
+
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            if (status == 0 && read_share(filename, cam, share, workers, pixels))
+            {
+                done[share] = 1;
+                std::remove(filename.c_str());
+                std::clog << "\rShare " << share + 1 << '/' << workers << " merged.          \n";
+                return;
+            }
+            std::clog << "\rShare " << share + 1 << '/' << workers << " failed (attempt " << attempt + 1;
+            if (hung)
+                std::clog << ", no heartbeat for " << heartbeat_timeout << " s";
+            else
+                std::clog << ", exit status " << status;
+            std::clog << ")" << (attempt + 1 < max_attempts ? ", reassigning.\n" : ".\n");
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int share = 0; share < workers; share++)
+        threads.emplace_back(run_share, share);
+    for (auto &t : threads)
+        t.join();
+
+    for (char d : done)
+        if (!d)
+            return false;
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "camera.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* 分布式渲染：多个worker进程各渲染一份交错的tile，协调进程合并结果 */
+// A frame is cut into tile shares: share k of N holds the tiles t with t % N == k. The coordinator
+// starts one worker process per share, a copy of the renderer invoked with the share on its
+// command line, which renders those tiles and leaves them in a share file. The coordinator then
+// copies every share into the frame. Tiles are seeded by their index in the whole frame, so the
+// merged image is bit-identical to a single-process render with the same camera.
+//
+// Processes talk only through share files, on a local disk or one every node mounts, so no
+// service has to run anywhere. A worker that exits without leaving a complete, matching file
+// (it crashed, was killed, or its node went away) has its share started again.
+//
+// While it runs, a worker also rewrites a small heartbeat file next to its share file every
+// second with a beat counter and the tiles it has finished. A worker whose heartbeat stops
+// changing for heartbeat_timeout seconds (a hung node, a stopped process, a launcher stuck on a
+// dead connection) is killed and its share started again as if it had failed.
+
+struct share_file_header
+{
+    char magic[8]; // "RTSHARE"
+    std::uint32_t width, height;
+    std::uint32_t share, share_count;
+    std::uint32_t tile_size;
+    std::uint32_t samples; // Samples per pixel actually taken
+    std::uint32_t seed;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(share_file_header) == 40, "share_file_header must stay 40 bytes");
+
+// Writes the tiles of cam's share from `pixels` (the whole frame, row by row): the header, then
+// each tile of the share in order, its pixels row by row as three doubles. The file appears under
+// its final name only once complete.
+bool write_share(const std::string &filename, const camera &cam, const std::vector<color> &pixels);
+
+// Copies the tiles of share `share` of `share_count` into `pixels`. Fails unless the file is
+// complete and was rendered with cam's resolution, tile size, sample count and seed.
+bool read_share(const std::string &filename, const camera &cam, int share, int share_count, std::vector<color> &pixels);
+
+// Name of the heartbeat file kept by the worker that writes `share_filename`.
+std::string heartbeat_filename(const std::string &share_filename);
+
+class share_heartbeat /* worker端：后台线程每秒写一次心跳文件 */
+{
+public:
+    // Starts beating into heartbeat_filename(share_filename) until destroyed. Point the worker
+    // camera's tiles_done at tiles_done() so the beats carry its progress.
+    explicit share_heartbeat(const std::string &share_filename);
+    ~share_heartbeat();
+
+    share_heartbeat(const share_heartbeat &) = delete;
+    share_heartbeat &operator=(const share_heartbeat &) = delete;
+
+    std::atomic<int> *tiles_done() { return &tiles; }
+
+private:
+    std::string filename;
+    std::atomic<int> tiles{0};
+    std::atomic<bool> stop{false};
+    std::thread beater;
+};
+
+class render_coordinator
+{
+public:
+    int workers = 2;                    // Number of shares, one worker process each
+    int max_attempts = 3;               // Starts of a share before the render gives up
+    std::string worker_command;         // Worker command line without the share arguments
+    std::vector<std::string> launchers; // Optional prefixes such as "ssh node7"; attempt a of share k
+                                        // runs through launchers[(k + a) % launchers.size()]
+    std::string directory = ".";        // Where workers leave share files
+    int heartbeat_timeout = 60;         // Seconds without a new heartbeat before a worker counts as
+                                        // hung; covers its start-up, so allow for slow launchers
+
+    // Runs the workers and merges their shares into `pixels`. The workers must render the same
+    // scene with the same camera settings as `cam`, which must be initialized. Returns false if a
+    // share failed on every attempt.
+    bool render(const camera &cam, std::vector<color> &pixels) const;
+
+    std::string share_filename(int share) const;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "environment.h"
+#include "../external/rtw_stb_image.h"
+#include "../tool/trace.h"
+
+bool environment_light::build()
+{
+    RT_TRACE_SCOPE("environment map");
+    rtw_image image(filename.c_str(), true); // Floats only, freed when the tables are built
+    width = image.width();
+    height = image.height();
+    total = 0;
+    if (width <= 0 || height <= 0 || !image.hdr_pixel_data(0, 0))
+    {
+        width = height = 0;
+        return false;
+    }
+
+    pixels.resize(size_t(width) * height * 3);
+    weights.resize(size_t(width) * height);
+    rows.resize(height);
+    columns.resize(size_t(width) * height);
+    std::vector<double> row_weight(height), column_weight(width);
+    for (int y = 0; y < height; y++)
+    {
+        auto sin_theta = std::sin(pi * (y + 0.5) / height);
+        row_weight[y] = 0;
+        for (int x = 0; x < width; x++)
+        {
+            auto k = size_t(y) * width + x;
+            const float *rgb = image.hdr_pixel_data(x, y);
+            for (int c = 0; c < 3; c++)
+                pixels[3 * k + c] = float(std::fmax(0.0, intensity * rgb[c]));
+            auto luminance = 0.2126 * pixels[3 * k] + 0.7152 * pixels[3 * k + 1] + 0.0722 * pixels[3 * k + 2];
+            weights[k] = float(luminance * sin_theta);
+            column_weight[x] = weights[k];
+            row_weight[y] += weights[k];
+        }
+        build_alias(column_weight.data(), width, &columns[size_t(y) * width]);
+        total += row_weight[y];
+    }
+    build_alias(row_weight.data(), height, rows.data());
+    return total > 0;
+}
+
+void environment_light::build_alias(const double *weight, size_t n, alias_entry *table)
+{
+    // Vose's method: scale the weights to average 1, then let every slot below 1 be topped up by
+    // one slot above 1, which keeps what is left over.
+    double sum = 0;
+    for (size_t k = 0; k < n; k++)
+        sum += weight[k];
+    std::vector<double> scaled(n);
+    std::vector<std::uint32_t> small, large;
+    for (size_t k = 0; k < n; k++)
+    {
+        scaled[k] = sum > 0 ? weight[k] * n / sum : 1.0; // A black row is never picked; keep it valid
+        (scaled[k] < 1 ? small : large).push_back(std::uint32_t(k));
+    }
+    while (!small.empty() && !large.empty())
+    {
+        auto s = small.back(), l = large.back();
+        small.pop_back();
+        table[s] = {float(scaled[s]), l};
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // What remains is 1 up to rounding.
+    for (auto k : large)
+        table[k] = {1.0f, k};
+    for (auto k : small)
+        table[k] = {1.0f, k};
+}
@@ -0,0 +1,107 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "../tool/rtweekend.h"
+#include "../tool/color.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* 环境光：等距柱状投影的HDR图，按亮度×sinθ重要性采样 */
+// Light from an equirectangular environment map around the scene, seen by every ray that leaves
+// the world. Row 0 of the image is straight up (+y) and the columns run around the vertical axis
+// the way sphere texture coordinates do; `rotation` turns the map about +y.
+//
+// build() turns the pixels into a piecewise-constant distribution over the sphere: each pixel is
+// weighted by its luminance times sin(theta), the solid angle its row covers. A row is picked
+// from the marginal alias table and a column from that row's alias table, both in constant time,
+// then a uniform point inside the pixel. pdf() gives the same density per solid angle, so the
+// camera can weigh environment samples against the BSDF and the other lights.
+//
+// Radiance is looked up at the nearest pixel, so it is exactly proportional to the sampling
+// density within every pixel.
+
+class environment_light
+{
+public:
+    environment_light(const std::string &filename, double intensity = 1, double rotation = 0)
+        : filename(filename), intensity(intensity), rotation(degrees_to_radians(rotation))
+    {
+    }
+
+    // Decodes the image and builds the sampling tables. Returns false if the image could not be
+    // read or is black everywhere; the light is then empty. The decoded image is released once
+    // its radiance is in `pixels`.
+    bool build();
+
+    bool empty() const { return total <= 0; }
+
+    color radiance(const vec3 &direction) const
+    {
+        auto k = pixel(unit_vector(direction));
+        return color(pixels[3 * k], pixels[3 * k + 1], pixels[3 * k + 2]);
+    }
+
+    vec3 sample() const
+    {
+        auto y = pick(rows.data(), height);
+        auto x = pick(&columns[size_t(y) * width], width);
+        auto theta = pi * (y + random_double()) / height;
+        auto phi = 2 * pi * (x + random_double()) / width + rotation;
+        auto sin_theta = std::sin(theta);
+        return vec3(-std::cos(phi) * sin_theta, std::cos(theta), std::sin(phi) * sin_theta);
+    }
+
+    double pdf(const vec3 &direction) const
+    {
+        // The pixel's share of the total, spread over its (theta, phi) rectangle and turned into
+        // a density per solid angle by dividing by sin(theta).
+        auto unit = unit_vector(direction);
+        auto sin_theta = std::sqrt(std::fmax(0.0, 1 - unit.y() * unit.y()));
+        if (sin_theta <= 0)
+            return 0;
+        return weights[pixel(unit)] / total * (double(width) * height) / (2 * pi * pi * sin_theta);
+    }
+
+    int image_width() const { return width; }
+    int image_height() const { return height; }
+
+private:
+    struct alias_entry
+    {
+        float probability; // Keep this slot with this probability, else take alias
+        std::uint32_t alias;
+    };
+
+    std::string filename;
+    double intensity, rotation;
+    int width = 0, height = 0;
+    std::vector<float> pixels;          // Radiance, RGB per pixel, intensity applied
+    std::vector<float> weights;         // Luminance times sin(theta) per pixel
+    double total = 0;                   // Sum of weights
+    std::vector<alias_entry> rows;      // Marginal over rows
+    std::vector<alias_entry> columns;   // Conditional over columns, width entries per row
+
+    size_t pixel(const vec3 &unit) const
+    {
+        auto theta = std::acos(std::fmax(-1.0, std::fmin(1.0, unit.y())));
+        auto phi = std::atan2(unit.z(), -unit.x()) - rotation; /* sample()的逆映射 */
+        phi -= 2 * pi * std::floor(phi / (2 * pi));
+        auto x = std::min(width - 1, int(phi / (2 * pi) * width));
+        auto y = std::min(height - 1, int(theta / pi * height));
+        return size_t(y) * width + x;
+    }
+
+    static int pick(const alias_entry *table, int n)
+    {
+        // One uniform number: its integer part picks the slot, its fraction decides for the alias.
+        auto u = random_double() * n;
+        auto k = std::min(n - 1, int(u));
+        return u - k < table[k].probability ? k : int(table[k].alias);
+    }
+
+    static void build_alias(const double *weight, size_t n, alias_entry *table);
+};
+
+#endif
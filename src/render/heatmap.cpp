@@ -0,0 +1,27 @@
+#include "heatmap.h"
+#include "../external/stb_image_write.h"
+
+double heatmap::write_png(const std::string &filename) const
+{
+    RT_TRACE_SCOPE("output encode");
+    if (cost.empty())
+        return -1;
+
+    std::vector<float> sorted(cost);
+    auto rank = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+    std::nth_element(sorted.begin(), rank, sorted.end());
+    double top = *rank > 0 ? *rank : 1.0;
+
+    std::vector<unsigned char> rgb(cost.size() * 3);
+    for (size_t k = 0; k < cost.size(); k++)
+    {
+        auto c = false_color(cost[k] / top);
+        rgb[3 * k + 0] = (unsigned char)(255.999 * c.x());
+        rgb[3 * k + 1] = (unsigned char)(255.999 * c.y());
+        rgb[3 * k + 2] = (unsigned char)(255.999 * c.z());
+    }
+
+    if (!stbi_write_png(filename.c_str(), width, height, 3, rgb.data(), width * 3))
+        return -1;
+    return top;
+}
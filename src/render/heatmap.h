@@ -0,0 +1,148 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "camera.h"
+#include "../tool/stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* 诊断渲染：每个像素记录其样本的开销，输出伪彩色PNG和原始浮点数据 */
+enum class heatmap_metric
+{
+    time,            // Wall time per pixel in microseconds
+    bvh_nodes,       // bvh_node::hit calls (needs RT_ENABLE_STATS)
+    primitive_tests, // Primitive intersection tests of every type (needs RT_ENABLE_STATS)
+    path_depth       // Mean path length in bounces (needs RT_ENABLE_STATS)
+};
+
+class heatmap
+{
+public:
+    int width = 0, height = 0;
+    std::vector<float> cost; // One value per pixel, row by row
+
+    static bool parse(const std::string &name, heatmap_metric &metric)
+    {
+        const char *names[] = {"time", "bvh_nodes", "primitive_tests", "path_depth"};
+        for (int i = 0; i < 4; i++)
+            if (name == names[i])
+            {
+                metric = heatmap_metric(i);
+                return true;
+            }
+        return false;
+    }
+
+    static bool available(heatmap_metric metric)
+    {
+#ifdef RT_ENABLE_STATS
+        return true;
+#else
+        return metric == heatmap_metric::time; // The other metrics read the stats counters.
+#endif
+    }
+
+    // Renders the image through the regular tile scheduler and measures every pixel on the thread
+    // that renders it. initialize() must have run on the camera.
+    void render(const camera &cam, const hittable &world, const hittable &lights, heatmap_metric metric,
+                std::vector<color> *pixels = nullptr)
+    {
+        width = cam.image_width;
+        height = cam.height();
+        cost.assign(size_t(width) * height, 0.0f);
+        if (pixels)
+            pixels->assign(cost.size(), color(0, 0, 0));
+
+        cam.for_each_tile([&](int x0, int y0, int x1, int y1)
+                          {
+            for (int j = y0; j < y1; j++)
+                for (int i = x0; i < x1; i++)
+                {
+                    auto before = sample(metric);
+                    auto c = cam.render_pixel(i, j, world, lights);
+                    auto after = sample(metric);
+                    cost[size_t(j) * width + i] = float(difference(metric, before, after));
+                    if (pixels)
+                        (*pixels)[size_t(j) * width + i] = c;
+                } });
+    }
+
+    // Writes the cost as a false-color PNG; values are scaled so the 99th percentile maps to the
+    // top of the color ramp, which keeps a few extreme pixels from flattening the rest.
+    // Returns the value used as the top of the scale, or a negative number on failure.
+    double write_png(const std::string &filename) const;
+
+    // Writes the unscaled cost as a single-channel PFM ("Pf") for further analysis.
+    bool write_raw(const std::string &filename) const
+    {
+        FILE *out = std::fopen(filename.c_str(), "wb");
+        if (!out)
+            return false;
+        std::fprintf(out, "Pf\n%d %d\n-1.0\n", width, height);
+        for (int j = height - 1; j >= 0; j--) // PFM scanlines run bottom to top
+            std::fwrite(&cost[size_t(j) * width], sizeof(float), width, out);
+        return std::fclose(out) == 0;
+    }
+
+    static color false_color(double t)
+    {
+        // Polynomial fit of the "turbo" colormap: dark blue for cheap, through green, to dark red.
+        t = std::clamp(t, 0.0, 1.0);
+        auto r = 0.13572138 + t * (4.61539260 + t * (-42.66032258 + t * (132.13108234 + t * (-152.94239396 + t * 59.28637943))));
+        auto g = 0.09140261 + t * (2.19418839 + t * (4.84296658 + t * (-14.18503333 + t * (4.27729857 + t * 2.82956604))));
+        auto b = 0.10667330 + t * (12.64194608 + t * (-60.58204836 + t * (110.36276771 + t * (-89.90310912 + t * 27.34824973))));
+        return color(std::clamp(r, 0.0, 1.0), std::clamp(g, 0.0, 1.0), std::clamp(b, 0.0, 1.0));
+    }
+
+private:
+    struct snapshot
+    {
+        std::chrono::steady_clock::time_point time;
+        long long count = 0; // nodes or primitive tests
+        long long paths = 0;
+        long long bounces = 0;
+    };
+
+    static snapshot sample(heatmap_metric metric)
+    {
+        snapshot s;
+        if (metric == heatmap_metric::time)
+        {
+            s.time = std::chrono::steady_clock::now();
+            return s;
+        }
+#ifdef RT_ENABLE_STATS
+        const auto &local = render_stats::local();
+        if (metric == heatmap_metric::bvh_nodes)
+            s.count = local.bvh_nodes_visited;
+        else if (metric == heatmap_metric::primitive_tests)
+            for (int i = 0; i < stat_primitive_count; i++)
+                s.count += local.primitive_tests[i];
+        else
+            for (int i = 0; i <= render_stats::max_path_length; i++)
+            {
+                s.paths += local.path_lengths[i];
+                s.bounces += i * local.path_lengths[i];
+            }
+#endif
+        return s;
+    }
+
+    static double difference(heatmap_metric metric, const snapshot &before, const snapshot &after)
+    {
+        if (metric == heatmap_metric::time)
+            return std::chrono::duration<double, std::micro>(after.time - before.time).count();
+        if (metric == heatmap_metric::path_depth)
+        {
+            auto paths = after.paths - before.paths;
+            return paths > 0 ? double(after.bounces - before.bounces) / paths : 0.0;
+        }
+        return double(after.count - before.count);
+    }
+};
+
+#endif
@@ -14,12 +14,21 @@ public:
     shared_ptr<pdf> pdf_ptr;/* PDF类 */
     bool skip_pdf;/* 对于金属和绝缘体为true，它们遵守反射或折射定律，对于漫反射需要PDF的混合，不用提前跳过 */
     ray skip_pdf_ray;/* 反射光线 */
+    closed_pdf surface; // Used instead of pdf_ptr when pdf_ptr is null (closed-world shading)
+
+    vec3 generate() const { return pdf_ptr ? pdf_ptr->generate() : surface.generate(); }
+    double pdf_value(const vec3 &direction) const { return pdf_ptr ? pdf_ptr->value(direction) : surface.value(direction); }
 };
 
 class material
 {
 public:
     virtual ~material() = default;
+
+    int shading_index = -1; // Slot in the last shading_table compiled over this material
+
+    // The scene_feature bits shading with this material needs; unknown materials may do anything.
+    virtual unsigned features() const { return feature_emitters | feature_specular | feature_textures; }
     virtual color emitted(
         const ray &r_in, const hit_record &rec, double u, double v, const point3 &p) const
     {
@@ -44,6 +53,12 @@ public:
     {
         return 0;
     }
+
+protected:
+    static unsigned texture_features(const shared_ptr<texture> &tex)
+    {
+        return dynamic_cast<const solid_color *>(tex.get()) ? 0u : unsigned(feature_textures);
+    }
 };
 class lambertian : public material
 {
@@ -77,8 +92,9 @@ public:
     }
     bool scatter(const ray &r_in, const hit_record &rec, scatter_record &srec) const override
     {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.attenuation = tex->value(rec.u, rec.v, rec.p, rec.footprint_u(), rec.footprint_v());
         srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);/* cos的PDF */
+        RT_STAT(allocations);
         srec.skip_pdf = false;
         return true;
     }
@@ -88,8 +104,10 @@ public:
         auto cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
         return cos_theta < 0 ? 0 : cos_theta / pi;
     }
+    unsigned features() const override { return texture_features(tex); }
 
 private:
+    friend class shading_table;
     shared_ptr<texture> tex;
 };
 
@@ -108,18 +126,24 @@ public:
         return (dot(scattered.direction(), rec.normal) > 0);
     }
      bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
-        vec3 reflected = reflect(r_in.direction(), rec.normal);
-        reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-
         srec.attenuation = albedo;
         srec.pdf_ptr = nullptr;
         srec.skip_pdf = true;
-        srec.skip_pdf_ray = ray(rec.p, reflected, r_in.time());/* 遵守反射定律 */
+        srec.skip_pdf_ray = ray(rec.p, reflection(r_in, rec, fuzz), r_in.time());/* 遵守反射定律 */
 
         return true;
     }
 
+    unsigned features() const override { return feature_specular; }
+
+    static vec3 reflection(const ray &r_in, const hit_record &rec, double fuzz) /* 模糊的镜面反射方向 */
+    {
+        vec3 reflected = reflect(r_in.direction(), rec.normal);
+        return unit_vector(reflected) + (fuzz * random_unit_vector());
+    }
+
 private:
+    friend class shading_table;
     color albedo;
     double fuzz;
 };
@@ -155,6 +179,14 @@ public:
         srec.attenuation = color(1.0, 1.0, 1.0);
         srec.pdf_ptr = nullptr;
         srec.skip_pdf = true;
+        srec.skip_pdf_ray = ray(rec.p, refraction(r_in, rec, refraction_index), r_in.time());/* 遵守折射定律 */
+        return true;
+    }
+
+    unsigned features() const override { return feature_specular; }
+
+    static vec3 refraction(const ray &r_in, const hit_record &rec, double refraction_index) /* 折射或反射方向 */
+    {
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
         vec3 unit_direction = unit_vector(r_in.direction());
@@ -162,18 +194,14 @@ public:
         double sin_theta = std::sqrt(1.0 - cos_theta*cos_theta);
 
         bool cannot_refract = ri * sin_theta > 1.0;
-        vec3 direction;
 
         if (cannot_refract || reflectance(cos_theta, ri) > random_double())
-            direction = reflect(unit_direction, rec.normal);
-        else
-            direction = refract(unit_direction, rec.normal, ri);
-
-        srec.skip_pdf_ray = ray(rec.p, direction, r_in.time());/* 遵守折射定律 */
-        return true;
+            return reflect(unit_direction, rec.normal);
+        return refract(unit_direction, rec.normal, ri);
     }
 
 private:
+    friend class shading_table;
     double refraction_index;
 
     static double reflectance(double cosine, double refraction_index)
@@ -195,10 +223,12 @@ public:
     {
         if (!rec.front_face)
             return color(0, 0, 0);
-        return tex->value(u, v, p);
+        return tex->value(u, v, p, rec.footprint_u(), rec.footprint_v());
     }
+    unsigned features() const override { return feature_emitters | texture_features(tex); }
 
 private:
+    friend class shading_table;
     shared_ptr<texture> tex;
 };
 class isotropic : public material
@@ -217,8 +247,9 @@ public:
     }
     bool scatter(const ray &r_in, const hit_record &rec, scatter_record &srec) const override
     {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.attenuation = tex->value(rec.u, rec.v, rec.p, rec.footprint_u(), rec.footprint_v());
         srec.pdf_ptr = make_shared<sphere_pdf>();/* 均匀PDF */
+        RT_STAT(allocations);
         srec.skip_pdf = false;/* 比如大理石材质，也属于漫反射 */
         return true;
     }
@@ -227,8 +258,10 @@ public:
     {
         return 1 / (4 * pi);
     }
+    unsigned features() const override { return feature_media | texture_features(tex); } // Scatters inside volumes
 
 private:
+    friend class shading_table;
     shared_ptr<texture> tex;
 };
 #endif
\ No newline at end of file
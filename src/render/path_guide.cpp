@@ -0,0 +1,69 @@
+#include "path_guide.h"
+#include "../tool/trace.h"
+
+#include <algorithm>
+
+void path_guide::initialize(const aabb &bounds)
+{
+    origin = point3(bounds.x.min, bounds.y.min, bounds.z.min);
+    auto longest = std::fmax(bounds.x.size(), std::fmax(bounds.y.size(), bounds.z.size()));
+    inv_cell_size = longest > 0 && longest < infinity ? cells_per_axis / longest : 1;
+
+    learned.assign(size_t(table_size) * bins, 0.0f);
+    counts.assign(table_size, 0);
+    finished_tiles.clear();
+    cdfs.clear();
+    weights.clear();
+    passes_done = 0;
+}
+
+void path_guide::finish_pass()
+{
+    RT_TRACE_SCOPE("path guide");
+    if (!learning() || learned.empty())
+        return;
+
+    // Add the pass's samples up tile by tile in a fixed order, so float rounding never depends
+    // on which thread finished first.
+    std::sort(finished_tiles.begin(), finished_tiles.end(), [](const auto &a, const auto &b)
+              { return a.first < b.first; });
+    for (const auto &tile : finished_tiles)
+        for (const auto &sample : tile.second)
+        {
+            learned[sample.slot] += sample.value;
+            counts[sample.slot / bins]++;
+        }
+    finished_tiles.clear();
+
+    cdfs.assign(size_t(table_size) * bins, 0.0f);
+    weights.assign(table_size, 0.0f);
+    for (int c = 0; c < table_size; c++)
+    {
+        const auto *values = &learned[size_t(c) * bins];
+        auto n = counts[c];
+        double total = 0;
+        for (int b = 0; b < bins; b++)
+            total += values[b];
+
+        // A tenth of the mass spread evenly keeps every direction reachable, so a bin that saw
+        // no light by chance is not shut off for good.
+        auto floor = total > 0 ? 0.1 * total / bins : 1.0;
+        double running = 0, sum = total > 0 ? 1.1 * total : bins;
+        for (int b = 0; b < bins; b++)
+        {
+            running += (total > 0 ? values[b] : 0.0) + floor;
+            cdfs[size_t(c) * bins + b] = float(running / sum);
+        }
+        cdfs[size_t(c) * bins + bins - 1] = 1.0f;
+
+        // Trust grows with the samples per bin; a few per bin are needed before the shape means much.
+        auto confidence = total > 0 ? double(n) / (n + 2.0 * bins) : 0.0;
+        weights[c] = float(max_weight * confidence);
+    }
+
+    if (++passes_done == training_passes)
+    {
+        learned = {}; // Frozen: nothing records anymore
+        counts = {};
+    }
+}
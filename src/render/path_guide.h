@@ -0,0 +1,170 @@
+#ifndef PATH_GUIDE_H
+#define PATH_GUIDE_H
+
+#include "../tool/rtweekend.h"
+#include "../tool/aabb.h"
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/* 路径引导：在空间哈希网格里学习每个区域的入射光方向分布，再按它采样 */
+// Path guiding. Space is cut into a grid of cells, each split further by which of the six axis
+// directions the surface normal is closest to, so the floor and a wall meeting in one cell learn
+// apart. The cells are hashed into a fixed table, and every cell keeps a histogram of the radiance arriving there over the sphere of directions: z = cos(theta)
+// in z_bins equal steps times phi in phi_bins steps, so every bin covers the same solid angle.
+//
+// While learning, the camera records at every diffuse vertex the luminance it found along the
+// scattered ray divided by the pdf it sampled with, an estimate of the radiance integrated over
+// that bin. After each learning pass finish_pass() turns everything recorded so far into
+// per-cell sampling tables, which the next passes draw from; after training_passes passes the
+// tables are frozen and recording stops.
+//
+// Samples are kept per tile, between begin_tile() and end_tile(), and finish_pass() adds the
+// tiles up in tile order. Every tile draws from its own seeded sequence, so the tables come out
+// bit-identical whatever the thread count and whichever thread rendered which tile, and the
+// workers of a distributed render all learn the same guide.
+//
+// The camera samples from a mixture of the light pdf, the BSDF pdf and the guide. The guide's
+// share at a point grows with the number of samples its cell has seen, up to max_weight, so
+// regions the guide knows little about keep sampling as before.
+
+class path_guide
+{
+public:
+    static const int z_bins = 8, phi_bins = 16, bins = z_bins * phi_bins;
+
+    int training_passes = 4;   // Passes that record before the tables are frozen
+    int cells_per_axis = 16;   // Grid resolution along the longest side of the bounds
+    double max_weight = 0.5;   // Largest share of guided samples in the mixture
+
+    void initialize(const aabb &bounds);
+
+    bool learning() const { return passes_done < training_passes; }
+    int passes() const { return passes_done; }
+
+    // Builds the sampling tables from all samples recorded so far; called after every learning pass.
+    void finish_pass();
+
+    // Brackets the rendering of a tile on the calling thread; `order` is the tile's place in the
+    // pass. Samples recorded outside a tile are dropped.
+    void begin_tile(int order)
+    {
+        if (!learning())
+            return;
+        auto &t = current_tile();
+        t.owner = this;
+        t.order = order;
+        t.samples.clear();
+    }
+
+    void end_tile()
+    {
+        auto &t = current_tile();
+        if (t.owner != this)
+            return;
+        t.owner = nullptr;
+        std::lock_guard<std::mutex> lock(tiles_mutex);
+        finished_tiles.emplace_back(t.order, std::move(t.samples));
+        t.samples = {};
+    }
+
+    int cell(const point3 &p, const vec3 &normal) const
+    {
+        auto x = (long long)std::floor((p.x() - origin.x()) * inv_cell_size);
+        auto y = (long long)std::floor((p.y() - origin.y()) * inv_cell_size);
+        auto z = (long long)std::floor((p.z() - origin.z()) * inv_cell_size);
+        auto ax = std::fabs(normal.x()), ay = std::fabs(normal.y()), az = std::fabs(normal.z());
+        int axis = ax >= ay && ax >= az ? 0 : ay >= az ? 1 : 2;
+        unsigned long long facing = 2 * axis + (normal[axis] < 0 ? 1 : 0);
+        auto h = (unsigned long long)x * 73856093ULL ^ (unsigned long long)y * 19349663ULL ^
+                 (unsigned long long)z * 83492791ULL ^ facing * 2654435761ULL;
+        return int(h & (table_size - 1));
+    }
+
+    double weight(int c) const { return weights.empty() ? 0.0 : weights[c]; } // Share of the mixture
+
+    vec3 sample(int c) const
+    {
+        // Pick a bin from the cell's cdf, then a uniform direction inside it.
+        const float *cdf = &cdfs[size_t(c) * bins];
+        auto u = float(random_double());
+        int lo = 0, hi = bins - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] <= u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        auto z = -1 + 2 * ((lo / phi_bins) + random_double()) / z_bins;
+        auto phi = 2 * pi * ((lo % phi_bins) + random_double()) / phi_bins;
+        auto r = std::sqrt(std::fmax(0.0, 1 - z * z));
+        return vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    double pdf(int c, const vec3 &direction) const
+    {
+        auto b = bin(unit_vector(direction));
+        const float *cdf = &cdfs[size_t(c) * bins];
+        auto p = cdf[b] - (b > 0 ? cdf[b - 1] : 0.0f);
+        return p * bins / (4 * pi);
+    }
+
+    void record(int c, const vec3 &direction, double value)
+    {
+        if (!(value >= 0) || value > 1e6)
+            return; // NaN or a firefly that would take over the bin
+        auto &t = current_tile();
+        if (t.owner == this)
+            t.samples.push_back({std::uint32_t(c) * bins + std::uint32_t(bin(unit_vector(direction))), float(value)});
+    }
+
+private:
+    static const int table_size = 1 << 14; // Hashed cells; distant cells may share one
+
+    point3 origin;
+    double inv_cell_size = 1;
+    int passes_done = 0;
+
+    struct recorded_sample
+    {
+        std::uint32_t slot; // cell * bins + bin
+        float value;
+    };
+
+    struct tile_samples /* 当前线程正在渲染的tile记录的样本 */
+    {
+        const path_guide *owner = nullptr;
+        int order = 0;
+        std::vector<recorded_sample> samples;
+    };
+
+    static tile_samples &current_tile()
+    {
+        thread_local tile_samples tile;
+        return tile;
+    }
+
+    std::mutex tiles_mutex;
+    std::vector<std::pair<int, std::vector<recorded_sample>>> finished_tiles; // Tiles of this pass, by order
+
+    std::vector<float> learned;                      // Recorded radiance per cell and bin
+    std::vector<int> counts;                         // Recorded samples per cell
+    std::vector<float> cdfs;                         // Frozen sampling tables, bins per cell
+    std::vector<float> weights;                      // Guide share per cell
+
+    static int bin(const vec3 &unit)
+    {
+        auto iz = std::min(z_bins - 1, int((unit.z() + 1) * 0.5 * z_bins));
+        auto phi = std::atan2(unit.y(), unit.x());
+        if (phi < 0)
+            phi += 2 * pi;
+        auto iphi = std::min(phi_bins - 1, int(phi / (2 * pi) * phi_bins));
+        return std::max(0, iz) * phi_bins + iphi;
+    }
+};
+
+#endif
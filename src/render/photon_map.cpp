@@ -0,0 +1,115 @@
+#include "photon_map.h"
+#include "material.h"
+#include "../tool/onb.h"
+#include "../tool/trace.h"
+
+size_t photon_map::build(const hittable &world, const hittable_list &lights, unsigned int seed)
+{
+    RT_TRACE_SCOPE("photon map");
+    photons.clear();
+    bucket_start.clear();
+    sources.clear();
+    if (radius <= 0)
+    {
+        auto box = world.bounding_box();
+        auto diagonal = vec3(box.x.size(), box.y.size(), box.z.size()).length();
+        radius = diagonal / 200;
+    }
+    inv_cell_size = 1 / (2 * radius);
+
+    // Lights are picked in proportion to their power, so every photon carries about the same.
+    // A diffuse emitter of radiance Le and area A sends out pi * A * Le.
+    struct emitter
+    {
+        const hittable *object;
+        double power;
+    };
+    std::vector<emitter> emitters;
+    double total_power = 0;
+    seed_random(seed);
+    for (const auto &light : lights.objects)
+    {
+        hit_record rec;
+        auto area = light->sample_surface(rec);
+        if (area <= 0 || !rec.mat)
+            continue;
+        auto le = rec.mat->emitted(ray(rec.p + rec.normal, -rec.normal), rec, rec.u, rec.v, rec.p);
+        auto power = pi * area * (le.x() + le.y() + le.z()) / 3;
+        if (power <= 0)
+            continue;
+        emitters.push_back({light.get(), power});
+        total_power += power;
+    }
+    if (emitters.empty() || photon_count <= 0)
+        return 0;
+    for (const auto &source : emitters)
+        sources.push_back(source.object);
+    std::sort(sources.begin(), sources.end());
+
+    for (int n = 0; n < photon_count; n++)
+    {
+        // Choose a light, a point on it and a cosine-weighted direction off its front side.
+        auto pick = random_double() * total_power;
+        size_t l = 0;
+        while (l + 1 < emitters.size() && pick >= emitters[l].power)
+            pick -= emitters[l++].power;
+        const auto &source = emitters[l];
+
+        hit_record rec;
+        auto area = source.object->sample_surface(rec);
+        auto le = rec.mat->emitted(ray(rec.p + rec.normal, -rec.normal), rec, rec.u, rec.v, rec.p);
+        // pdf of this photon: (power_l / total) * (1 / area) * (cos / pi), against Le * cos.
+        color power = le * (pi * area * total_power / (source.power * photon_count));
+
+        onb uvw(rec.normal);
+        ray r(rec.p, uvw.transform(random_cosine_direction()), 0.0);
+        int specular = 0;
+        for (int bounce = 0; bounce <= max_bounces; bounce++)
+        {
+            hit_record hit;
+            if (!world.hit(r, interval(0.001, infinity), hit))
+                break;
+            scatter_record srec;
+            if (!hit.mat->scatter(r, hit, srec))
+                break;
+            if (srec.skip_pdf)
+            {
+                power = power * srec.attenuation;
+                r = ray(hit.p, srec.skip_pdf_ray.direction(), 0.0);
+                specular++;
+                continue;
+            }
+            if (specular > 0 && !(hit.mat->features() & feature_media))
+            {
+                auto from = unit_vector(-r.direction());
+                photons.push_back({{float(hit.p.x()), float(hit.p.y()), float(hit.p.z())},
+                                   {float(from.x()), float(from.y()), float(from.z())},
+                                   {float(power.x()), float(power.y()), float(power.z())}});
+            }
+            break;
+        }
+    }
+
+    // Counting sort into the hash buckets; twice as many buckets as photons keeps them short.
+    std::uint32_t buckets = 1;
+    while (buckets < 2 * photons.size())
+        buckets <<= 1;
+    bucket_mask = buckets - 1;
+    bucket_start.assign(size_t(buckets) + 1, 0);
+    std::vector<std::uint32_t> slot(photons.size());
+    for (size_t k = 0; k < photons.size(); k++)
+    {
+        const auto &ph = photons[k];
+        auto c = cell(point3(ph.position[0], ph.position[1], ph.position[2]));
+        slot[k] = bucket(c[0], c[1], c[2]);
+        bucket_start[slot[k] + 1]++;
+    }
+    for (std::uint32_t b = 0; b < buckets; b++)
+        bucket_start[b + 1] += bucket_start[b];
+    std::vector<photon> sorted(photons.size());
+    auto next = bucket_start;
+    for (size_t k = 0; k < photons.size(); k++)
+        sorted[next[slot[k]]++] = photons[k];
+    photons.swap(sorted);
+    return photons.size();
+}
@@ -0,0 +1,128 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include "../obj/hittable.h"
+#include "../obj/hittable_list.h"
+#include "../tool/color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/* 焦散光子图：从光源发射光子，经过镜面反射/折射后落在漫反射表面上的才保存 */
+// A caustic photon map. build() shoots photons from the emitting objects of the light list and
+// follows them through specular bounces (skip_pdf scatters: metal and glass). A photon that
+// reaches a non-specular surface after at least one such bounce is stored there. Photons that
+// reach a diffuse surface directly, or scatter in a medium, are dropped: the path tracer already
+// finds that light well.
+//
+// The camera adds estimate() at the first diffuse surface of a path and drops the emission the
+// path reaches from there over specular bounces from a light that shot photons, which is the
+// light the photons carry. Caustics then come from a density estimate instead of from the rare
+// sample that happens to pass through the glass onto a light. They come out smooth at low sample
+// counts, blurred by the gather radius.
+//
+// Only lights that implement sample_surface (quads and spheres) shoot photons. Other emitters,
+// and emitters missing from the light list, keep their caustics from paths: shot_from() tells
+// the camera which emission the photons already carry.
+//
+// Photons are sorted into a spatial hash with cells twice the gather radius, so a lookup reads at
+// most eight short contiguous runs of photons (27 when rounding lands on a cell boundary).
+
+class photon_map
+{
+public:
+    int photon_count = 200000; // Photons emitted from the lights
+    double radius = 0;         // Gather radius; 0 picks 1/200 of the world's bounding box diagonal
+    int max_bounces = 16;      // Specular bounces a photon may take before it is dropped
+
+    // Shoots the photons, starting from `seed`, and returns how many were stored. Lights are
+    // sampled through hittable::sample_surface; those that cannot be sampled are skipped.
+    size_t build(const hittable &world, const hittable_list &lights, unsigned int seed = 0);
+
+    size_t size() const { return photons.size(); }
+    bool empty() const { return photons.empty(); }
+
+    // Whether `object` shot photons in the last build(), so its caustics are in the map.
+    bool shot_from(const hittable *object) const
+    {
+        return std::binary_search(sources.begin(), sources.end(), object);
+    }
+
+    // Reflected caustic radiance at p on a surface with the given normal. brdf(wi) is the surface
+    // BRDF towards the unit direction wi the photon came from.
+    template <class Brdf>
+    color estimate(const point3 &p, const vec3 &normal, const Brdf &brdf) const
+    {
+        if (photons.empty())
+            return color(0, 0, 0);
+
+        // Cells are 2r wide, so the box spans two cells per axis, but rounding in cell() can
+        // make it three near a cell boundary: up to 27 buckets.
+        std::uint32_t visited[27];
+        int visited_count = 0;
+        color sum(0, 0, 0);
+        auto r2 = radius * radius;
+        auto lo = cell(p - vec3(radius, radius, radius)), hi = cell(p + vec3(radius, radius, radius));
+        for (auto x = lo[0]; x <= hi[0]; x++)
+            for (auto y = lo[1]; y <= hi[1]; y++)
+                for (auto z = lo[2]; z <= hi[2]; z++)
+                {
+                    // Two neighbouring cells may hash to one bucket; read it only once.
+                    auto b = bucket(x, y, z);
+                    bool seen = false;
+                    for (int k = 0; k < visited_count; k++)
+                        seen = seen || visited[k] == b;
+                    if (seen)
+                        continue;
+                    visited[visited_count++] = b;
+
+                    for (auto k = bucket_start[b]; k < bucket_start[b + 1]; k++)
+                    {
+                        const auto &ph = photons[k];
+                        vec3 d(ph.position[0] - p.x(), ph.position[1] - p.y(), ph.position[2] - p.z());
+                        if (d.length_squared() > r2)
+                            continue;
+                        vec3 wi(ph.direction[0], ph.direction[1], ph.direction[2]);
+                        if (dot(wi, normal) <= 0)
+                            continue; // Arrived on the other side
+                        sum += brdf(wi) * color(ph.power[0], ph.power[1], ph.power[2]);
+                    }
+                }
+        return sum / (pi * r2);
+    }
+
+private:
+    struct photon
+    {
+        float position[3];
+        float direction[3]; // Unit vector back towards where the photon came from
+        float power[3];
+    };
+
+    std::vector<photon> photons;              // Sorted by bucket
+    std::vector<const hittable *> sources;    // Emitters that shot photons, sorted by address
+    std::vector<std::uint32_t> bucket_start;  // Bucket b holds photons [bucket_start[b], bucket_start[b + 1])
+    double inv_cell_size = 0;
+    std::uint32_t bucket_mask = 0;
+
+    struct cell_index
+    {
+        long long v[3];
+        long long operator[](int k) const { return v[k]; }
+    };
+
+    cell_index cell(const point3 &p) const
+    {
+        return {{(long long)std::floor(p.x() * inv_cell_size), (long long)std::floor(p.y() * inv_cell_size),
+                 (long long)std::floor(p.z() * inv_cell_size)}};
+    }
+
+    std::uint32_t bucket(long long x, long long y, long long z) const
+    {
+        auto h = (unsigned long long)x * 73856093ULL ^ (unsigned long long)y * 19349663ULL ^ (unsigned long long)z * 83492791ULL;
+        return std::uint32_t(h) & bucket_mask;
+    }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "preview.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char frame_magic[8] = "RTFRAME";
+
+bool shared_framebuffer::create(const std::string &filename, int width, int height)
+{
+    close();
+    auto size = framebuffer_header::pixel_offset + size_t(width) * height * 4;
+    unsigned char *base = nullptr;
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(std::uint64_t(size) >> 32), DWORD(size), nullptr);
+    if (!mapping)
+    {
+        close();
+        return false;
+    }
+    base = static_cast<unsigned char *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (!base)
+    {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, off_t(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    if (address == MAP_FAILED)
+        return false;
+    base = static_cast<unsigned char *>(address);
+#endif
+    length = size;
+    header = new (base) framebuffer_header(); /* 文件是新建的，全为零 */
+    std::memcpy(header->magic, frame_magic, sizeof(header->magic));
+    header->width = std::uint32_t(width);
+    header->height = std::uint32_t(height);
+    pixels = base + framebuffer_header::pixel_offset;
+    return true;
+}
+
+void shared_framebuffer::close()
+{
+    auto base = reinterpret_cast<unsigned char *>(header);
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    mapping = file = nullptr;
+#else
+    if (base)
+        munmap(base, length);
+#endif
+    header = nullptr;
+    pixels = nullptr;
+    length = 0;
+}
+
+void shared_framebuffer::publish(const std::vector<color> &image, int w, int h, unsigned int generation, int scale, int samples)
+{
+    if (!header)
+        return;
+    RT_TRACE_SCOPE("output encode");
+    auto &frame = *header;
+    int fw = int(frame.width), fh = int(frame.height);
+
+    // Seqlock: odd while writing, so a reader can tell a torn frame from a whole one.
+    frame.sequence.fetch_add(1, std::memory_order_acq_rel);
+    for (int j = 0; j < fh; j++)
+    {
+        auto row = &image[size_t(std::min(h - 1, j * h / fh)) * w];
+        auto out = pixels + size_t(j) * fw * 4;
+        for (int i = 0; i < fw; i++, out += 4)
+        {
+            color_to_bytes(row[std::min(w - 1, i * w / fw)], out);
+            out[3] = 255;
+        }
+    }
+    frame.generation = generation;
+    frame.scale = std::uint32_t(scale);
+    frame.samples = std::uint32_t(samples);
+    frame.sequence.fetch_add(1, std::memory_order_release);
+}
+
+preview_renderer::preview_renderer(const hittable &world, const hittable &lights, shared_framebuffer &framebuffer)
+    : world(world), lights(lights), framebuffer(framebuffer)
+{
+    worker = std::thread(&preview_renderer::loop, this);
+}
+
+preview_renderer::~preview_renderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+        stale = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+unsigned int preview_renderer::update(const camera &cam)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = cam;
+    has_pending = true;
+    stale = true; // The running pass gives up at its next tile
+    wake.notify_all();
+    return ++generation;
+}
+
+void preview_renderer::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait(lock, [this]
+              { return closing || (!has_pending && !busy); });
+}
+
+void preview_renderer::loop()
+{
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return closing || has_pending; });
+        if (closing)
+            return;
+        auto cam = pending;
+        auto gen = generation.load();
+        has_pending = false;
+        busy = true;
+        stale = false; // Under the lock, so a later update() always raises it again
+        lock.unlock();
+
+        refine(cam, gen);
+
+        lock.lock();
+        busy = false;
+        wake.notify_all();
+    }
+}
+
+void preview_renderer::refine(camera cam, unsigned int gen)
+{
+    auto start = std::chrono::steady_clock::now();
+    int full_width = cam.image_width, target = std::max(1, cam.samples_per_pixel);
+    cam.show_progress = false;
+    cam.cancel = &stale;
+    auto base_seed = cam.seed;
+    int pass_index = 0;
+
+    auto render_pass = [&](int scale, int spp, std::vector<color> &pixels)
+    {
+        auto c = cam;
+        c.image_width = std::max(1, full_width / scale);
+        c.samples_per_pixel = spp;
+        c.seed = base_seed + pass_index++; // Every pass draws fresh samples
+        c.initialize();
+        c.render_image(world, lights, pixels);
+        return c;
+    };
+    auto report = [&](int scale, int samples)
+    {
+        if (on_pass)
+            on_pass({gen, scale, samples, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()});
+    };
+
+    // Coarse passes at one sample per pixel, each replacing the previous one.
+    std::vector<color> pixels;
+    for (int scale = 8; scale > 1; scale /= 2)
+    {
+        if (full_width / scale < 1)
+            continue;
+        auto c = render_pass(scale, 1, pixels);
+        if (stale)
+            return;
+        framebuffer.publish(pixels, c.image_width, c.height(), gen, scale, c.samples_taken_per_pixel());
+        report(scale, c.samples_taken_per_pixel());
+    }
+
+    // Full resolution: accumulate passes that roughly double the samples taken until the target
+    // is reached. Pass sizes are perfect squares, so stratification takes every sample asked for.
+    std::vector<color> sum, average;
+    int taken = 0;
+    while (taken < target)
+    {
+        auto side = int(std::sqrt(std::min(std::max(1, taken), target - taken)));
+        auto c = render_pass(1, side * side, pixels);
+        if (stale)
+            return;
+        int n = c.samples_taken_per_pixel();
+        sum.resize(pixels.size(), color(0, 0, 0));
+        average.resize(pixels.size());
+        for (size_t k = 0; k < pixels.size(); k++)
+        {
+            sum[k] += n * pixels[k];
+            average[k] = sum[k] / (taken + n);
+        }
+        taken += n;
+        framebuffer.publish(average, c.image_width, c.height(), gen, 1, taken);
+        report(1, taken);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "camera.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* 交互式预览：先低分辨率低采样出图，再逐级细化 */
+// A progressive preview for camera and look-dev work. After every change the image is rendered
+// at 1/8 resolution with one sample per pixel, then at 1/4, 1/2 and full resolution, and from
+// there keeps accumulating passes of doubling sample counts up to the camera's samples_per_pixel.
+// Each finished pass is published into a shared framebuffer: a file mapped into memory that a
+// viewer maps too and displays in place, without a copy or a pipe in between. Low-resolution
+// passes are published scaled up to the full size.
+//
+// Every update() starts a new generation. The pass of an older generation stops at its next tile
+// and is never published, so stale work costs at most one tile per render thread.
+
+struct framebuffer_header
+{
+    char magic[8];                       // "RTFRAME"
+    std::uint32_t width, height;         // RGBA8 pixels follow the header, row by row
+    std::uint32_t generation;            // Camera generation the pixels belong to
+    std::uint32_t scale;                 // Resolution divisor of the published pass: 8, 4, 2 or 1
+    std::uint32_t samples;               // Samples per pixel accumulated so far
+    std::atomic<std::uint32_t> sequence; // Odd while the pixels are being written
+
+    static const size_t pixel_offset = 64;
+};
+
+static_assert(sizeof(framebuffer_header) <= framebuffer_header::pixel_offset, "framebuffer_header outgrew its slot");
+
+class shared_framebuffer /* 共享内存帧缓冲 */
+{
+public:
+    shared_framebuffer() {}
+    ~shared_framebuffer() { close(); }
+
+    shared_framebuffer(const shared_framebuffer &) = delete;
+    shared_framebuffer &operator=(const shared_framebuffer &) = delete;
+
+    // Creates (or truncates) `filename` for a width x height image and maps it read-write and
+    // shared. On Linux a path under /dev/shm keeps the pixels off the disk.
+    bool create(const std::string &filename, int width, int height);
+    void close();
+
+    int width() const { return header ? int(header->width) : 0; }
+    int height() const { return header ? int(header->height) : 0; }
+
+    // Copies `pixels` (w x h, row by row) into the frame, scaled to its size by nearest neighbour.
+    // A reader that sees the same even sequence number before and after reading got a whole frame.
+    void publish(const std::vector<color> &pixels, int w, int h, unsigned int generation, int scale, int samples);
+
+private:
+    framebuffer_header *header = nullptr;
+    unsigned char *pixels = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr;
+#endif
+};
+
+struct preview_pass
+{
+    unsigned int generation;
+    int scale;            // Resolution divisor
+    int samples;          // Samples per pixel accumulated at this resolution
+    double milliseconds;  // Since the update that started the generation
+};
+
+class preview_renderer
+{
+public:
+    // world and lights must stay unchanged while the preview runs; camera changes go to update().
+    preview_renderer(const hittable &world, const hittable &lights, shared_framebuffer &framebuffer);
+    ~preview_renderer();
+
+    // Starts refining the image of `cam` (not yet initialized) and abandons the current work.
+    unsigned int update(const camera &cam);
+
+    // Blocks until the current generation is fully refined or superseded.
+    void wait();
+
+    // Called on the preview thread after every published pass.
+    std::function<void(const preview_pass &)> on_pass;
+
+private:
+    const hittable &world;
+    const hittable &lights;
+    shared_framebuffer &framebuffer;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    camera pending;
+    bool has_pending = false, busy = false, closing = false;
+    std::atomic<unsigned int> generation{0};
+    std::atomic<bool> stale{false}; // Raised by update() to stop the running pass
+    std::thread worker;
+
+    void loop();
+    void refine(camera cam, unsigned int gen);
+};
+
+#endif
@@ -19,10 +19,25 @@ public:
         return orig + t * dir;
     }
 
+    // Ray cone for texture filtering: the beam is `width` wide at the origin and widens by
+    // `spread` per unit of distance travelled. A ray without a cone is a point sample.
+    void set_cone(double width, double spread)
+    {
+        cone_w = width;
+        cone_s = spread;
+    }
+    double cone_width() const { return cone_w; }
+    double cone_spread() const { return cone_s; }
+    double footprint(double t) const /* t处光锥的宽度 */
+    {
+        return cone_s > 0 ? cone_w + cone_s * t * dir.length() : cone_w;
+    }
+
 private:
     point3 orig;
     vec3 dir;
     double tm;
+    double cone_w = 0, cone_s = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "shading_table.h"
+
+#include <typeinfo>
+
+void shading_table::compile(const hittable &world)
+{
+    textures.clear();
+    materials.clear();
+    owners.clear();
+    texture_slots.clear();
+    open = 0;
+
+    // Walk the scene graph; shared subtrees are visited once per reference, materials only once.
+    std::function<void(const hittable &)> walk = [&](const hittable &object)
+    {
+        if (auto mat = object.surface_material())
+        {
+            auto index = mat->shading_index;
+            if (index < 0 || size_t(index) >= owners.size() || owners[index] != mat.get())
+                add_material(*mat);
+        }
+        object.for_each_child(walk);
+    };
+    walk(world);
+    texture_slots.clear();
+}
+
+void shading_table::add_material(material &mat)
+{
+    // Exact types only: a subclass of a known kind may override its functions and stays open.
+    const auto &type = typeid(mat);
+    material_kind kind = open_material{&mat};
+    if (type == typeid(lambertian))
+        kind = lambertian_material{add_texture(static_cast<const lambertian &>(mat).tex)};
+    else if (type == typeid(metal))
+        kind = metal_material{static_cast<const metal &>(mat).albedo, static_cast<const metal &>(mat).fuzz};
+    else if (type == typeid(dielectric))
+        kind = dielectric_material{static_cast<const dielectric &>(mat).refraction_index};
+    else if (type == typeid(diffuse_light))
+        kind = light_material{add_texture(static_cast<const diffuse_light &>(mat).tex)};
+    else if (type == typeid(isotropic))
+        kind = isotropic_material{add_texture(static_cast<const isotropic &>(mat).tex)};
+    else
+        open++;
+
+    mat.shading_index = int(materials.size());
+    materials.push_back(kind);
+    owners.push_back(&mat);
+}
+
+int shading_table::add_texture(const shared_ptr<texture> &tex)
+{
+    auto found = texture_slots.find(tex.get());
+    if (found != texture_slots.end())
+        return found->second;
+
+    const auto &type = typeid(*tex);
+    texture_kind kind = open_texture{tex.get()};
+    if (type == typeid(solid_color))
+        kind = solid{static_cast<const solid_color &>(*tex).albedo};
+    else if (type == typeid(checker_texture))
+    {
+        const auto &t = static_cast<const checker_texture &>(*tex);
+        kind = checker{t.inv_scale, add_texture(t.even), add_texture(t.odd)}; // Children first
+    }
+    else if (type == typeid(image_texture))
+        kind = image{static_cast<const image_texture *>(tex.get())};
+    else if (type == typeid(noise_texture))
+        kind = noise{static_cast<const noise_texture *>(tex.get())};
+    else
+        open++;
+
+    auto index = int(textures.size());
+    textures.push_back(kind);
+    texture_slots[tex.get()] = index;
+    return index;
+}
@@ -0,0 +1,214 @@
+#ifndef SHADING_TABLE_H
+#define SHADING_TABLE_H
+
+#include "material.h"
+#include "texture.h"
+
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+/* 封闭世界着色：材质和纹理存为连续数组里的variant，用std::visit分派，没有虚函数调用 */
+// An opt-in closed-world form of a scene's materials and textures. compile() walks the scene
+// once and converts every material and texture of a known kind into a plain struct inside a
+// std::variant, all of them in two contiguous arrays; checker textures refer to their two
+// textures by index. Shading through the table is a std::visit over a closed set of types, which
+// the compiler turns into a switch with every case inlined, and surface pdfs travel by value in
+// scatter_record::surface. Kinds the table does not know stay open: they are kept as pointers and
+// shaded through their virtual functions as before, so the result is the same either way.
+//
+// The table holds plain pointers into the scene's materials and textures; the scene must outlive
+// it and stay unchanged.
+
+class shading_table
+{
+public:
+    void compile(const hittable &world);
+
+    size_t material_count() const { return materials.size(); }
+    size_t texture_count() const { return textures.size(); }
+    size_t open_count() const { return open; } // Materials and textures shaded through virtual calls
+
+    color emitted(const ray &r_in, const hit_record &rec) const
+    {
+        auto m = find(rec);
+        if (!m)
+            return rec.mat->emitted(r_in, rec, rec.u, rec.v, rec.p);
+        if (auto light = std::get_if<light_material>(m))
+            return rec.front_face ? texture_value(light->tex, rec.u, rec.v, rec.p, rec.footprint_u(), rec.footprint_v())
+                                  : color(0, 0, 0);
+        if (auto other = std::get_if<open_material>(m))
+            return other->mat->emitted(r_in, rec, rec.u, rec.v, rec.p);
+        return color(0, 0, 0);
+    }
+
+    bool scatter(const ray &r_in, const hit_record &rec, scatter_record &srec) const
+    {
+        auto m = find(rec);
+        if (!m)
+            return rec.mat->scatter(r_in, rec, srec);
+        srec.pdf_ptr = nullptr;
+        return std::visit([&](const auto &k)
+                          { return scatter(k, r_in, rec, srec); }, *m);
+    }
+
+    double scattering_pdf(const ray &r_in, const hit_record &rec, const ray &scattered) const
+    {
+        auto m = find(rec);
+        if (!m)
+            return rec.mat->scattering_pdf(r_in, rec, scattered);
+        if (std::holds_alternative<lambertian_material>(*m))
+        {
+            auto cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
+            return cos_theta < 0 ? 0 : cos_theta / pi;
+        }
+        if (std::holds_alternative<isotropic_material>(*m))
+            return 1 / (4 * pi);
+        if (auto other = std::get_if<open_material>(m))
+            return other->mat->scattering_pdf(r_in, rec, scattered);
+        return 0;
+    }
+
+    color texture_value(int index, double u, double v, const point3 &p, double du, double dv) const
+    {
+        // Checkers are resolved in a loop; the leaf is shaded in the visit.
+        for (;;)
+        {
+            const auto &t = textures[index];
+            if (auto c = std::get_if<checker>(&t))
+            {
+                auto sum = int(std::floor(c->inv_scale * p.x())) + int(std::floor(c->inv_scale * p.y())) +
+                           int(std::floor(c->inv_scale * p.z()));
+                index = sum % 2 == 0 ? c->even : c->odd;
+                continue;
+            }
+            return std::visit([&](const auto &k)
+                              { return value(k, u, v, p, du, dv); }, t);
+        }
+    }
+
+private:
+    struct solid
+    {
+        color albedo;
+    };
+    struct checker
+    {
+        double inv_scale;
+        int even, odd;
+    };
+    struct image
+    {
+        const image_texture *tex;
+    };
+    struct noise
+    {
+        const noise_texture *tex;
+    };
+    struct open_texture
+    {
+        const texture *tex;
+    };
+    using texture_kind = std::variant<solid, checker, image, noise, open_texture>;
+
+    struct lambertian_material
+    {
+        int tex;
+    };
+    struct metal_material
+    {
+        color albedo;
+        double fuzz;
+    };
+    struct dielectric_material
+    {
+        double refraction_index;
+    };
+    struct light_material
+    {
+        int tex;
+    };
+    struct isotropic_material
+    {
+        int tex;
+    };
+    struct open_material
+    {
+        const material *mat;
+    };
+    using material_kind = std::variant<lambertian_material, metal_material, dielectric_material, light_material,
+                                       isotropic_material, open_material>;
+
+    std::vector<texture_kind> textures;
+    std::vector<material_kind> materials;
+    std::vector<const material *> owners; // owners[i] is the material compiled into materials[i]
+    size_t open = 0;
+
+    // Only used while compiling.
+    std::unordered_map<const texture *, int> texture_slots;
+
+    const material_kind *find(const hit_record &rec) const
+    {
+        // A material compiled by another table (or none) is shaded through its virtual functions.
+        auto index = rec.mat->shading_index;
+        if (index < 0 || size_t(index) >= materials.size() || owners[index] != rec.mat.get())
+            return nullptr;
+        return &materials[index];
+    }
+
+    void add_material(material &mat);
+    int add_texture(const shared_ptr<texture> &tex);
+
+    // Texture leaves. Named calls to the final overriders skip the vtable.
+    static color value(const solid &t, double, double, const point3 &, double, double) { return t.albedo; }
+    static color value(const checker &, double, double, const point3 &, double, double) { return color(0, 0, 0); } // Resolved by the caller
+    static color value(const image &t, double u, double v, const point3 &p, double du, double dv)
+    {
+        return t.tex->image_texture::value(u, v, p, du, dv);
+    }
+    static color value(const noise &t, double u, double v, const point3 &p, double, double)
+    {
+        return t.tex->noise_texture::value(u, v, p);
+    }
+    static color value(const open_texture &t, double u, double v, const point3 &p, double du, double dv)
+    {
+        return t.tex->value(u, v, p, du, dv);
+    }
+
+    // Material kinds, each mirroring the scatter() of its class.
+    bool scatter(const lambertian_material &m, const ray &, const hit_record &rec, scatter_record &srec) const
+    {
+        srec.attenuation = texture_value(m.tex, rec.u, rec.v, rec.p, rec.footprint_u(), rec.footprint_v());
+        srec.surface = cosine_pdf(rec.normal);
+        srec.skip_pdf = false;
+        return true;
+    }
+    bool scatter(const metal_material &m, const ray &r_in, const hit_record &rec, scatter_record &srec) const
+    {
+        srec.attenuation = m.albedo;
+        srec.skip_pdf = true;
+        srec.skip_pdf_ray = ray(rec.p, metal::reflection(r_in, rec, m.fuzz), r_in.time());
+        return true;
+    }
+    bool scatter(const dielectric_material &m, const ray &r_in, const hit_record &rec, scatter_record &srec) const
+    {
+        srec.attenuation = color(1.0, 1.0, 1.0);
+        srec.skip_pdf = true;
+        srec.skip_pdf_ray = ray(rec.p, dielectric::refraction(r_in, rec, m.refraction_index), r_in.time());
+        return true;
+    }
+    bool scatter(const light_material &, const ray &, const hit_record &, scatter_record &) const { return false; }
+    bool scatter(const isotropic_material &m, const ray &, const hit_record &rec, scatter_record &srec) const
+    {
+        srec.attenuation = texture_value(m.tex, rec.u, rec.v, rec.p, rec.footprint_u(), rec.footprint_v());
+        srec.surface = sphere_pdf();
+        srec.skip_pdf = false;
+        return true;
+    }
+    bool scatter(const open_material &m, const ray &r_in, const hit_record &rec, scatter_record &srec) const
+    {
+        return m.mat->scatter(r_in, rec, srec);
+    }
+};
+
+#endif
@@ -1,7 +1,7 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 #include "../tool/color.h"
-#include "../external/rtw_stb_image.h"
+#include "texture_cache.h"
 #include "perlin.h"
 class texture
 {
@@ -9,6 +9,13 @@ public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3 &p) const = 0;
+
+    // Lookup filtered over a footprint of du x dv in texture coordinates (see hit_record). Textures
+    // without prefiltered data ignore the footprint.
+    virtual color value(double u, double v, const point3 &p, double du, double dv) const
+    {
+        return value(u, v, p);
+    }
 };
 
 class solid_color : public texture
@@ -24,6 +31,7 @@ public:
     }
 
 private:
+    friend class shading_table;
     color albedo;
 };
 class checker_texture : public texture
@@ -37,45 +45,56 @@ public:
 
     color value(double u, double v, const point3 &p) const override
     {
-        auto xInteger = int(std::floor(inv_scale * p.x()));
-        auto yInteger = int(std::floor(inv_scale * p.y()));
-        auto zInteger = int(std::floor(inv_scale * p.z()));
-
-        bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
+        return pick(p).value(u, v, p);
+    }
 
-        return isEven ? even->value(u, v, p) : odd->value(u, v, p);
+    color value(double u, double v, const point3 &p, double du, double dv) const override
+    {
+        return pick(p).value(u, v, p, du, dv);
     }
 
 private:
+    friend class shading_table;
     double inv_scale;
     shared_ptr<texture> even;
     shared_ptr<texture> odd;
+
+    const texture &pick(const point3 &p) const
+    {
+        auto xInteger = int(std::floor(inv_scale * p.x()));
+        auto yInteger = int(std::floor(inv_scale * p.y()));
+        auto zInteger = int(std::floor(inv_scale * p.z()));
+
+        bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
+
+        return isEven ? *even : *odd;
+    }
 };
 class image_texture : public texture
 {
 public:
-    image_texture(const char *filename) : image(filename) {}
+    image_texture(const char *filename) : image(mip_image::open(filename)) {}
 
     color value(double u, double v, const point3 &p) const override
+    {
+        return value(u, v, p, 0, 0);
+    }
+
+    color value(double u, double v, const point3 &p, double du, double dv) const override
     {
         // If we have no texture data, then return solid cyan as a debugging aid.
-        if (image.height() <= 0)
+        if (!image->valid())
             return color(0, 1, 1);
 
         // Clamp input texture coordinates to [0,1] x [1,0]
         u = interval(0, 1).clamp(u);
         v = 1.0 - interval(0, 1).clamp(v); // Flip V to image coordinates
 
-        auto i = int(u * image.width());
-        auto j = int(v * image.height());
-        auto pixel = image.pixel_data(i, j);
-
-        auto color_scale = 1.0 / 255.0;
-        return color(color_scale * pixel[0], color_scale * pixel[1], color_scale * pixel[2]);
+        return image->sample(u, v, du, dv);
     }
 
 private:
-    rtw_image image;
+    shared_ptr<const mip_image> image; /* 同名文件共享；tile由全局texture_cache按需生成 */
 };
 class noise_texture : public texture {
   public:
@@ -0,0 +1,190 @@
+#include "texture_cache.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+struct texture_cache::shard
+{
+    struct entry
+    {
+        std::shared_ptr<const texture_tile> tile;
+        std::list<unsigned long long>::iterator lru_position;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<unsigned long long, entry> tiles;
+    std::list<unsigned long long> lru; // Most recently used first
+    size_t bytes = 0;
+};
+
+texture_cache::texture_cache() : shards(new shard[shard_count]) {}
+texture_cache::~texture_cache() {}
+
+texture_cache &texture_cache::global()
+{
+    static texture_cache cache;
+    return cache;
+}
+
+void texture_cache::set_capacity(size_t bytes)
+{
+    // Takes effect as tiles are added; call it before rendering.
+    capacity_bytes = bytes;
+}
+
+size_t texture_cache::resident_bytes() const
+{
+    size_t total = 0;
+    for (int s = 0; s < shard_count; s++)
+    {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        total += shards[s].bytes;
+    }
+    return total + source_bytes;
+}
+
+unsigned int texture_cache::next_image_id()
+{
+    static std::atomic<unsigned int> next(0);
+    return next++;
+}
+
+const unsigned char *texture_cache::fetch(const mip_image &image, int level, int tx, int ty, lookaside_entry &slot)
+{
+    auto key = tile_key(image.id(), level, tx, ty);
+    auto &s = shards[(key ^ key >> 40) % shard_count];
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto found = s.tiles.find(key);
+        if (found != s.tiles.end())
+        {
+            s.lru.splice(s.lru.begin(), s.lru, found->second.lru_position);
+            slot.key = key;
+            slot.tile = found->second.tile;
+            return slot.tile->texels;
+        }
+    }
+
+    // Fill without holding the lock: coarser levels read the level below through the cache.
+    auto created = std::make_shared<texture_tile>();
+    image.fill_tile(level, tx, ty, created->texels);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto found = s.tiles.find(key);
+    if (found != s.tiles.end()) // Another thread filled it meanwhile
+    {
+        slot.key = key;
+        slot.tile = found->second.tile;
+        return slot.tile->texels;
+    }
+
+    s.lru.push_front(key);
+    s.tiles[key] = {created, s.lru.begin()};
+    s.bytes += sizeof(texture_tile);
+
+    /* 超出该分片的份额时淘汰最久未用的tile；解码后的原图先占用上限 */
+    auto sources = source_bytes.load();
+    auto shard_capacity = (capacity_bytes > sources ? capacity_bytes - sources : 0) / shard_count;
+    while (s.bytes > shard_capacity && s.lru.size() > 1)
+    {
+        s.tiles.erase(s.lru.back());
+        s.lru.pop_back();
+        s.bytes -= sizeof(texture_tile);
+    }
+
+    slot.key = key;
+    slot.tile = created;
+    return created->texels;
+}
+
+void texture_cache::erase(unsigned int image_id)
+{
+    for (int i = 0; i < shard_count; i++)
+    {
+        auto &s = shards[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto k = s.lru.begin(); k != s.lru.end();)
+        {
+            if ((*k >> 40) == (image_id & 0xffffff))
+            {
+                s.tiles.erase(*k);
+                k = s.lru.erase(k);
+                s.bytes -= sizeof(texture_tile);
+            }
+            else
+                ++k;
+        }
+    }
+}
+
+mip_image::mip_image(std::shared_ptr<const rtw_image> image)
+    : image(std::move(image)), image_id(texture_cache::global().next_image_id()) {}
+
+void mip_image::prepare() const
+{
+    std::call_once(levels_once, [this]()
+                   {
+        if (image->height() <= 0)
+            return;
+        source_bytes = size_t(image->width()) * image->height() * 3;
+        texture_cache::global().add_source_bytes(source_bytes);
+
+        // Halve each side down to 1x1; odd sizes round down and drop the last row or column.
+        int w = image->width(), h = image->height();
+        for (;;)
+        {
+            levels.push_back({w, h});
+            if (w == 1 && h == 1)
+                break;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        } });
+}
+
+std::shared_ptr<const mip_image> mip_image::open(const std::string &filename)
+{
+    static std::mutex opened_mutex;
+    static std::map<std::string, std::weak_ptr<const mip_image>> opened;
+
+    std::lock_guard<std::mutex> lock(opened_mutex);
+    auto &entry = opened[filename];
+    auto mip = entry.lock();
+    if (!mip)
+    {
+        mip = std::make_shared<mip_image>(image_registry::get(filename));
+        entry = mip;
+    }
+    return mip;
+}
+
+mip_image::~mip_image()
+{
+    texture_cache::global().erase(image_id);
+    texture_cache::global().remove_source_bytes(source_bytes);
+}
+
+void mip_image::fill_tile(int level, int tx, int ty, unsigned char *texels) const
+{
+    for (int j = 0; j < texture_tile_size; j++)
+        for (int i = 0; i < texture_tile_size; i++)
+        {
+            int x = tx * texture_tile_size + i, y = ty * texture_tile_size + j;
+            auto out = texels + 3 * (j * texture_tile_size + i);
+
+            // Box filter of the 2x2 texels below, averaged in linear space; texel() clamps at the
+            // edges of the level. Each texel is read right away, its pointer is only valid until
+            // the next lookup.
+            float sum[3] = {0, 0, 0};
+            for (int k = 0; k < 4; k++)
+            {
+                auto below = texel(level - 1, 2 * x + (k & 1), 2 * y + (k >> 1));
+                for (int c = 0; c < 3; c++)
+                    sum[c] += rtw_image::byte_to_linear(below[c]);
+            }
+            for (int c = 0; c < 3; c++)
+                out[c] = rtw_image::linear_to_byte(sum[c] / 4);
+        }
+}
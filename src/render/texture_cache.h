@@ -0,0 +1,198 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "../tool/color.h"
+#include "../external/rtw_stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Mip-mapped image textures. Level 0 is read straight from the decoded image's sRGB bytes, the
+// only copy of the full resolution texels. The coarser levels are square tiles that a
+// process-wide texture_cache creates on first use, by box-filtering the level below, and drops
+// least recently used first once the memory cap is reached, so a tile costs memory only while
+// some part of the scene samples it. The cap covers the decoded images too: tiles get what the
+// images leave of it.
+
+static const int texture_tile_size = 32; // Texels per tile edge; a tile is 3 KB
+
+struct texture_tile /* 一个tile的RGB字节 */
+{
+    unsigned char texels[texture_tile_size * texture_tile_size * 3];
+};
+
+class mip_image;
+
+class texture_cache
+{
+public:
+    static texture_cache &global();
+
+    // Upper bound for the texel memory of the decoded images and all resident tiles. Tiles still
+    // held by a thread's short lookaside list may outlive their eviction for a few lookups.
+    void set_capacity(size_t bytes);
+    size_t capacity() const { return capacity_bytes; }
+    size_t resident_bytes() const; // Decoded images plus tiles
+
+    // Decoded level 0 images count against the cap; mip_image reports them as they come and go.
+    void add_source_bytes(size_t bytes) { source_bytes += bytes; }
+    void remove_source_bytes(size_t bytes) { source_bytes -= bytes; }
+
+    // Texels of tile (tx, ty) of `level`, created on a miss. The pointer stays valid until the
+    // calling thread's next lookup.
+    const unsigned char *tile(const mip_image &image, int level, int tx, int ty);
+
+    static unsigned long long tile_key(unsigned int image_id, int level, int tx, int ty)
+    {
+        // 24 bits image, 8 bits level, 16 bits per tile coordinate.
+        return (unsigned long long)(image_id & 0xffffff) << 40 | (unsigned long long)level << 32 |
+               (unsigned long long)(ty & 0xffff) << 16 | (unsigned long long)(tx & 0xffff);
+    }
+
+    void erase(unsigned int image_id); // Drops every tile of an image
+    unsigned int next_image_id();
+
+    texture_cache();
+    ~texture_cache();
+
+private:
+    // A small per-thread list in front of the shards: most lookups of a bilinear or trilinear
+    // sample land in a tile the thread has just used, and are answered without taking a lock.
+    struct lookaside_entry
+    {
+        unsigned long long key = ~0ULL;
+        std::shared_ptr<const texture_tile> tile;
+    };
+    static const int lookaside_size = 64;
+
+    static lookaside_entry &lookaside(unsigned long long key)
+    {
+        thread_local lookaside_entry entries[lookaside_size];
+        return entries[(key ^ key >> 13 ^ key >> 40) & (lookaside_size - 1)];
+    }
+
+    const unsigned char *fetch(const mip_image &image, int level, int tx, int ty, lookaside_entry &slot);
+
+    struct shard;
+    static const int shard_count = 16; /* 分片加锁，减少线程争用 */
+    std::unique_ptr<shard[]> shards;
+    size_t capacity_bytes = size_t(256) << 20;
+    std::atomic<size_t> source_bytes{0};
+};
+
+class mip_image
+{
+public:
+    explicit mip_image(std::shared_ptr<const rtw_image> image);
+    ~mip_image();
+
+    mip_image(const mip_image &) = delete;
+    mip_image &operator=(const mip_image &) = delete;
+
+    // The mip-mapped image of a file, shared by every texture that names it so its tiles are
+    // cached once. Nothing is decoded until the first lookup.
+    static std::shared_ptr<const mip_image> open(const std::string &filename);
+
+    // The accessors below decode the image on first use; sample() expects valid() was checked.
+    bool valid() const { return prepare(), !levels.empty(); }
+    int width() const { return valid() ? levels[0].width : 0; }
+    int height() const { return valid() ? levels[0].height : 0; }
+    int level_count() const { return prepare(), int(levels.size()); }
+    unsigned int id() const { return image_id; }
+
+    // Trilinear lookup at (u, v) in [0,1]^2 (v grows downwards in the image) for a footprint of
+    // du x dv in texture coordinates. The mip level follows the larger side of the footprint; a
+    // zero footprint samples the full resolution image bilinearly.
+    color sample(double u, double v, double du, double dv) const
+    {
+        auto texels = std::max(du * levels[0].width, dv * levels[0].height);
+        auto lod = texels > 1 ? std::log2(texels) : 0.0;
+        if (lod >= level_count() - 1)
+            return bilinear(level_count() - 1, u, v);
+
+        int level = int(lod);
+        auto fine = bilinear(level, u, v);
+        auto t = lod - level;
+        if (t <= 0)
+            return fine;
+        return (1 - t) * fine + t * bilinear(level + 1, u, v);
+    }
+
+    // Called by the cache on a miss: fills one tile of `level`, which is 1 or coarser.
+    void fill_tile(int level, int tx, int ty, unsigned char *texels) const;
+
+private:
+    struct level_size
+    {
+        int width, height;
+    };
+
+    std::shared_ptr<const rtw_image> image; // Source of level 0
+    mutable std::vector<level_size> levels;
+    mutable std::once_flag levels_once;
+    unsigned int image_id;
+
+    mutable size_t source_bytes = 0; // Reported to the cache by prepare()
+
+    void prepare() const;
+
+    const unsigned char *texel(int level, int x, int y) const
+    {
+        if (level == 0)
+            return image->pixel_data(x, y); // Clamps to the image
+        const auto &size = levels[level];
+        x = rtw_image::clamp(x, 0, size.width);
+        y = rtw_image::clamp(y, 0, size.height);
+        auto texels = texture_cache::global().tile(*this, level, x / texture_tile_size, y / texture_tile_size);
+        return texels + 3 * ((y % texture_tile_size) * texture_tile_size + x % texture_tile_size);
+    }
+
+    static color texel_color(const unsigned char *t)
+    {
+        return color(rtw_image::byte_to_linear(t[0]), rtw_image::byte_to_linear(t[1]), rtw_image::byte_to_linear(t[2]));
+    }
+
+    color bilinear(int level, double u, double v) const
+    {
+        const auto &size = levels[level];
+        auto x = u * size.width - 0.5;
+        auto y = v * size.height - 0.5;
+        auto x0 = int(std::floor(x)), y0 = int(std::floor(y));
+        auto fx = x - x0, fy = y - y0;
+
+        // Usually all four texels are in one tile, which then takes a single lookup.
+        int x_lo = rtw_image::clamp(x0, 0, size.width), x_hi = rtw_image::clamp(x0 + 1, 0, size.width);
+        int y_lo = rtw_image::clamp(y0, 0, size.height), y_hi = rtw_image::clamp(y0 + 1, 0, size.height);
+        color c00, c10, c01, c11;
+        if (level > 0 && x_lo / texture_tile_size == x_hi / texture_tile_size && y_lo / texture_tile_size == y_hi / texture_tile_size)
+        {
+            auto t = texture_cache::global().tile(*this, level, x_lo / texture_tile_size, y_lo / texture_tile_size);
+            auto at = [t](int x, int y)
+            { return t + 3 * ((y % texture_tile_size) * texture_tile_size + x % texture_tile_size); };
+            c00 = texel_color(at(x_lo, y_lo)), c10 = texel_color(at(x_hi, y_lo));
+            c01 = texel_color(at(x_lo, y_hi)), c11 = texel_color(at(x_hi, y_hi));
+        }
+        else
+        {
+            c00 = texel_color(texel(level, x_lo, y_lo)), c10 = texel_color(texel(level, x_hi, y_lo));
+            c01 = texel_color(texel(level, x_lo, y_hi)), c11 = texel_color(texel(level, x_hi, y_hi));
+        }
+        return (1 - fy) * ((1 - fx) * c00 + fx * c10) + fy * ((1 - fx) * c01 + fx * c11);
+    }
+};
+
+inline const unsigned char *texture_cache::tile(const mip_image &image, int level, int tx, int ty)
+{
+    auto key = tile_key(image.id(), level, tx, ty);
+    auto &slot = lookaside(key);
+    if (slot.key == key)
+        return slot.tile->texels;
+    return fetch(image, level, tx, ty, slot);
+}
+
+#endif
@@ -0,0 +1,338 @@
+#include "render_server.h"
+#include "../tool/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using server_clock = std::chrono::steady_clock;
+
+static double milliseconds_since(server_clock::time_point from)
+{
+    return std::chrono::duration<double, std::milli>(server_clock::now() - from).count();
+}
+
+unsigned long long scene_cache::build_key(const render_job &job)
+{
+    // FNV-1a over the builder's name, the build options and a stamp of each file the builder
+    // reads. Scenes are built by code, so these are what decides their content.
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const std::string &text)
+    {
+        for (unsigned char c : text)
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        hash = (hash ^ 0xff) * 0x100000001b3ULL; // Separator, so ("ab","c") != ("a","bc")
+    };
+    mix(job.scene_name);
+    mix(job.accel);
+    if (auto entry = find_scene(job.scene_name))
+        for (const auto &file : entry->files)
+        {
+            struct stat info;
+            if (stat(file.c_str(), &info) == 0)
+                mix(file + ":" + std::to_string(info.st_size) + ":" + std::to_string((long long)info.st_mtime));
+            else
+                mix(file + ":missing");
+        }
+    return hash;
+}
+
+std::shared_ptr<const scene> scene_cache::get(const render_job &job, bool &was_cached)
+{
+    auto key = build_key(job);
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+        if (it->key == key)
+        {
+            entries.splice(entries.begin(), entries, it);
+            was_cached = true;
+            return entries.front().built;
+        }
+
+    was_cached = false;
+    auto found = find_scene(job.scene_name);
+    if (!found)
+        return nullptr;
+
+    // Random scenes come out as in a fresh process, whichever job loaded them first.
+    seed_random(std::mt19937::default_seed);
+    auto built = std::make_shared<scene>(found->make());
+    if (job.accel == "bvh" || job.accel == "compact")
+        built->use_bvh = true;
+    else if (job.accel == "none")
+        built->use_bvh = false;
+    built->use_compact_bvh = job.accel == "compact";
+    built->build();
+
+    entries.push_front({key, built});
+    if (entries.size() > capacity)
+        entries.pop_back(); // Jobs still rendering it keep their own reference
+    return built;
+}
+
+void render_server::say(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(out_mutex);
+    *reply << line << std::endl;
+}
+
+bool render_server::parse_job(const std::vector<std::string> &words, render_job &job, std::string &error)
+{
+    // words: "render", id, key=value...
+    job.id = words[1];
+    for (size_t k = 2; k < words.size(); k++)
+    {
+        auto eq = words[k].find('=');
+        if (eq == std::string::npos)
+        {
+            error = "expected key=value, got " + words[k];
+            return false;
+        }
+        auto key = words[k].substr(0, eq), value = words[k].substr(eq + 1);
+        double x, y, z;
+        if (key == "scene")
+            job.scene_name = value;
+        else if (key == "accel" && (value == "scene" || value == "bvh" || value == "compact" || value == "none"))
+            job.accel = value;
+        else if (key == "out")
+            job.output = value;
+        else if (key == "priority")
+            job.priority = std::atoi(value.c_str());
+        else if (key == "passes")
+            job.passes = std::max(1, std::atoi(value.c_str()));
+        else if (key == "width")
+            job.width = std::atoi(value.c_str());
+        else if (key == "spp")
+            job.spp = std::atoi(value.c_str());
+        else if (key == "depth")
+            job.depth = std::atoi(value.c_str());
+        else if (key == "seed")
+            job.seed = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "vfov")
+            job.vfov = std::atof(value.c_str());
+        else if ((key == "lookfrom" || key == "lookat") && std::sscanf(value.c_str(), "%lf,%lf,%lf", &x, &y, &z) == 3)
+        {
+            (key == "lookfrom" ? job.lookfrom : job.lookat) = point3(x, y, z);
+            (key == "lookfrom" ? job.set_lookfrom : job.set_lookat) = true;
+        }
+        else
+        {
+            error = "bad option " + words[k];
+            return false;
+        }
+    }
+    if (job.scene_name.empty())
+    {
+        error = "missing scene=<name>";
+        return false;
+    }
+    if (job.output.empty())
+        job.output = job.id + ".ppm";
+    return true;
+}
+
+void render_server::handle(const std::string &line)
+{
+    std::istringstream tokens(line);
+    std::vector<std::string> words;
+    for (std::string word; tokens >> word;)
+        words.push_back(word);
+    if (words.empty())
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (words[0] == "render" && words.size() >= 2)
+    {
+        auto job = std::make_shared<render_job>();
+        std::string error;
+        if (!parse_job(words, *job, error))
+        {
+            lock.unlock();
+            say("error " + words[1] + " " + error);
+            return;
+        }
+        job->sequence = next_sequence++;
+        queue.push_back(job);
+        std::push_heap(queue.begin(), queue.end(), later);
+        say("queued " + job->id); // Before the render thread can report it started
+        lock.unlock();
+        wake.notify_one();
+    }
+    else if (words[0] == "cancel" && words.size() == 2)
+    {
+        // A queued job is dropped here; a running one stops at its next tile and the render
+        // thread reports it.
+        bool found = false;
+        std::vector<std::string> dropped;
+        for (auto it = queue.begin(); it != queue.end();)
+            if ((*it)->id == words[1])
+            {
+                dropped.push_back((*it)->id);
+                it = queue.erase(it);
+            }
+            else
+                ++it;
+        std::make_heap(queue.begin(), queue.end(), later);
+        if (running && running->id == words[1])
+        {
+            running->cancelled = true;
+            found = true;
+        }
+        lock.unlock();
+        for (const auto &id : dropped)
+            say("cancelled " + id);
+        if (!found && dropped.empty())
+            say("error " + words[1] + " no such job");
+    }
+    else if (words[0] == "status")
+    {
+        auto line = "status running=" + (running ? running->id : std::string("-")) +
+                    " queued=" + std::to_string(queue.size());
+        lock.unlock();
+        say(line + " scenes=" + std::to_string(cached_scenes.load()));
+    }
+    else if (words[0] == "quit")
+        closing = true;
+    else
+    {
+        lock.unlock();
+        say("error - unknown command: " + words[0]);
+    }
+}
+
+void render_server::render(render_job &job)
+{
+    auto start = server_clock::now();
+    bool was_cached = false;
+    auto s = scenes.get(job, was_cached); // Traced as "scene load" by scene_entry::make on a miss
+    cached_scenes = scenes.size();
+    if (!s)
+    {
+        say("error " + job.id + " unknown scene " + job.scene_name);
+        return;
+    }
+
+    camera cam = s->cam;
+    if (job.width > 0)
+        cam.image_width = job.width;
+    if (job.spp > 0)
+        cam.samples_per_pixel = job.spp;
+    if (job.depth > 0)
+        cam.max_depth = job.depth;
+    if (job.vfov > 0)
+        cam.vfov = job.vfov;
+    if (job.set_lookfrom)
+        cam.lookfrom = job.lookfrom;
+    if (job.set_lookat)
+        cam.lookat = job.lookat;
+    if (job.seed)
+        cam.seed = job.seed;
+    cam.show_progress = false;
+    cam.cancel = &job.cancelled;
+
+    // Split the samples a single pass would stratify into perfect squares, largest first.
+    cam.initialize();
+    std::vector<int> pass_samples;
+    for (int left = cam.samples_taken_per_pixel(), p = job.passes; left > 0; p = std::max(1, p - 1))
+    {
+        auto side = std::max(1, int(std::sqrt(left / p)));
+        pass_samples.push_back(side * side);
+        left -= side * side;
+    }
+    int passes = int(pass_samples.size());
+    auto base_seed = cam.seed;
+
+    std::ostringstream started;
+    started << "started " << job.id << " setup_ms=" << milliseconds_since(start) << " cached=" << was_cached;
+    say(started.str());
+
+    auto render_start = server_clock::now();
+    std::vector<color> sum(size_t(cam.image_width) * cam.height(), color(0, 0, 0)), pass_pixels, average;
+    int taken = 0;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        cam.seed = base_seed + pass; // Passes are independent sample sets
+        cam.samples_per_pixel = pass_samples[pass];
+        cam.initialize();
+        cam.render_image(s->world, s->light_sampler(), pass_pixels);
+        if (job.cancelled)
+        {
+            say("cancelled " + job.id);
+            return;
+        }
+
+        // Weigh each pass by its samples, so the average equals one render of them all.
+        taken += pass_samples[pass];
+        for (size_t k = 0; k < sum.size(); k++)
+            sum[k] += pass_samples[pass] * pass_pixels[k];
+        average.resize(sum.size());
+        for (size_t k = 0; k < sum.size(); k++)
+            average[k] = sum[k] / taken;
+
+        // Rename into place so a viewer polling the file never reads half an image.
+        auto partial = job.output + ".part";
+        {
+            std::ofstream out(partial);
+            cam.write_image(out, average);
+        }
+        std::remove(job.output.c_str());
+        if (std::rename(partial.c_str(), job.output.c_str()) != 0)
+        {
+            say("error " + job.id + " cannot write " + job.output);
+            return;
+        }
+        if (pass + 1 < passes)
+            say("progress " + job.id + " " + std::to_string(pass + 1) + "/" + std::to_string(passes) + " " + job.output);
+    }
+
+    std::ostringstream done;
+    done << "done " << job.id << " render_ms=" << milliseconds_since(render_start) << " " << job.output;
+    say(done.str());
+}
+
+void render_server::render_loop()
+{
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return closing || !queue.empty(); });
+        if (queue.empty())
+            return; // Closing and nothing left
+        std::pop_heap(queue.begin(), queue.end(), later);
+        auto job = queue.back();
+        queue.pop_back();
+        running = job;
+        lock.unlock();
+
+        render(*job);
+
+        lock.lock();
+        running = nullptr;
+    }
+}
+
+void render_server::run(std::istream &in, std::ostream &out)
+{
+    reply = &out;
+    std::thread renderer(&render_server::render_loop, this);
+    for (std::string line; std::getline(in, line);)
+    {
+        handle(line);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closing)
+            break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wake.notify_one();
+    renderer.join();
+}
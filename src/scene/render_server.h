@@ -0,0 +1,119 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include "scenes.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* 常驻渲染服务：场景和BVH在任务之间保持加载 */
+// A long-running renderer that takes jobs as text lines, one command per line:
+//
+//   render <id> scene=<name> [priority=N] [passes=N] [out=file.ppm] [accel=scene|bvh|compact|none]
+//          [width=N] [spp=N] [depth=N] [seed=N] [vfov=X] [lookfrom=x,y,z] [lookat=x,y,z]
+//   cancel <id>
+//   status
+//   quit
+//
+// and answers with lines of its own: "queued <id>", "started <id> setup_ms=X cached=0|1",
+// "progress <id> <pass>/<passes> <file>", "done <id> render_ms=X <file>", "cancelled <id>",
+// "error <id> <message>", and for status one "status running=<id>|- queued=N scenes=N" line.
+//
+// Built scenes, acceleration structures included, are cached under a hash of what determines
+// their content, so a job on a warm scene starts tracing as soon as its camera is set up. Jobs
+// run one at a time, each using every render thread, highest priority first and first come first
+// served among equals. With passes=N the job's samples are split into about N passes with their
+// own seeds, and the running average is written to the output file after each one. Pass sizes
+// are perfect squares, so stratification takes every sample; when the total does not split
+// evenly, a few small passes make up the rest and the job takes exactly the samples of one pass.
+
+struct render_job
+{
+    std::string id;
+    std::string scene_name;
+    std::string accel = "scene"; // The scene's own choice, bvh_node, compact_bvh or no BVH
+    std::string output;          // <id>.ppm unless given
+    int priority = 0;            // Higher runs first
+    int passes = 1;
+
+    // Camera overrides; zero or unset keeps the scene's own value.
+    int width = 0, spp = 0, depth = 0;
+    unsigned int seed = 0;
+    double vfov = 0;
+    bool set_lookfrom = false, set_lookat = false;
+    point3 lookfrom, lookat;
+
+    long long sequence = 0; // Arrival order
+    std::atomic<bool> cancelled{false};
+};
+
+class scene_cache
+{
+public:
+    size_t capacity = 8; // Built scenes kept; the least recently used one goes first
+
+    // The built scene for the job's scene and acceleration options, loaded and built on a miss.
+    // Returns null for an unknown scene name.
+    std::shared_ptr<const scene> get(const render_job &job, bool &was_cached);
+
+    // Hash of everything that shapes a built scene: the builder's name, the build options and
+    // the size and modification time of every file the builder reads, so an edited texture or
+    // mesh is loaded again.
+    static unsigned long long build_key(const render_job &job);
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct entry
+    {
+        unsigned long long key;
+        std::shared_ptr<const scene> built;
+    };
+    std::list<entry> entries; // Most recently used first
+};
+
+class render_server
+{
+public:
+    // Reads commands from `in` until "quit" or end of input, then finishes the running job and
+    // the queue before returning.
+    void run(std::istream &in, std::ostream &out);
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::shared_ptr<render_job>> queue; /* 按优先级维护的堆 */
+    std::shared_ptr<render_job> running;
+    bool closing = false;
+    long long next_sequence = 0;
+
+    std::mutex out_mutex;
+    std::ostream *reply = nullptr;
+
+    scene_cache scenes; // Used by the render thread only
+    std::atomic<size_t> cached_scenes{0}; /* 供status读取 */
+
+    static bool later(const std::shared_ptr<render_job> &a, const std::shared_ptr<render_job> &b)
+    {
+        // Heap order: a runs after b.
+        if (a->priority != b->priority)
+            return a->priority < b->priority;
+        return a->sequence > b->sequence;
+    }
+
+    void handle(const std::string &line);
+    void render_loop();
+    void render(render_job &job);
+    void say(const std::string &line);
+    static bool parse_job(const std::vector<std::string> &words, render_job &job, std::string &error);
+};
+
+#endif
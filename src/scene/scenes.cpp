@@ -0,0 +1 @@
+#include "scenes.h"
\ No newline at end of file
@@ -0,0 +1,753 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "../tool/rtweekend.h"
+#include "../obj/hittable.h"
+#include "../obj/hittable_list.h"
+#include "../obj/sphere.h"
+#include "../obj/quad.h"
+#include "../obj/constant_medium.h"
+#include "../obj/grid_medium.h"
+#include "../obj/mapped_mesh.h"
+#include "../render/camera.h"
+#include "../render/material.h"
+#include "../tool/BVH.h"
+#include "../tool/compact_BVH.h"
+#include "../tool/light_BVH.h"
+#include "../tool/arena.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* 场景：物体、光源和相机。加速结构在build()中构建，便于单独计时 */
+class scene
+{
+public:
+    // Objects of the scene are placed in its arena, the acceleration structures built over them
+    // are not. Copies of a scene share the arena.
+    template <class T, class... Args>
+    shared_ptr<T> make(Args &&...args) { return storage->make<T>(std::forward<Args>(args)...); }
+    scene_arena &arena() { return *storage; }
+
+private:
+    shared_ptr<scene_arena> storage = make_shared<scene_arena>(); // First, so it is destroyed last
+
+public:
+    hittable_list world;
+    hittable_list lights;       // Shared with the world so a traced hit can be matched to a light
+    camera cam;
+    bool use_bvh = false;       // Wrap the world in a bvh_node
+    bool use_compact_bvh = false; // With use_bvh, build a compact_bvh instead
+    bool use_light_bvh = false; // Pick lights through a light_bvh instead of uniformly
+    bool use_closed_shading = false; // Shade through a shading_table instead of virtual calls
+    bool use_feature_integrator = true; // Render with the integrator specialized for world.features()
+    int caustic_photons = 0;    // Photons shot for a caustic photon map, 0 renders caustics by path tracing
+    bool use_path_guiding = false; // Learn where light comes from and sample towards it
+    std::string environment_map;   // Equirectangular image lighting the scene instead of the background color
+    double environment_intensity = 1; // Scale of the environment map's radiance
+    double environment_rotation = 0;  // Turn of the environment map about +y, in degrees
+
+    struct build_timings /* build()各阶段的耗时，毫秒 */
+    {
+        double image_decode = 0, bvh = 0, light_set = 0, shading = 0, photon_map = 0, environment_map = 0;
+
+        double total() const { return image_decode + bvh + light_set + shading + photon_map + environment_map; }
+    };
+    build_timings build_times; // Phases of the last build()
+
+    void build()
+    {
+        // Each phase is timed on its own, so a benchmark can tell the BVH from the rest of setup.
+        auto mark = std::chrono::steady_clock::now();
+        auto lap = [&mark](double &milliseconds)
+        {
+            auto now = std::chrono::steady_clock::now();
+            milliseconds = std::chrono::duration<double, std::milli>(now - mark).count();
+            mark = now;
+        };
+        build_times = build_timings();
+
+        image_registry::decode_pending(); /* 纹理并行解码，不占用第一个像素的时间 */
+        lap(build_times.image_decode);
+
+        if (use_bvh)
+        {
+            RT_TRACE_SCOPE("BVH build");
+            if (use_compact_bvh)
+                world = hittable_list(make_shared<compact_bvh>(world));
+            else
+                world = hittable_list(make_shared<bvh_node>(world));
+        }
+        lap(build_times.bvh);
+
+        {
+            RT_TRACE_SCOPE("light set");
+            if (use_light_bvh)
+                light_set = make_shared<light_bvh>(lights);
+            else
+                light_set = make_shared<hittable_list>(lights);
+        }
+        lap(build_times.light_set);
+
+        shading = nullptr;
+        if (use_closed_shading)
+        {
+            RT_TRACE_SCOPE("shading compile");
+            shading = make_shared<shading_table>();
+            shading->compile(world);
+        }
+        cam.shading = shading.get();
+        cam.features = use_feature_integrator ? world.features() : unsigned(feature_all);
+        lap(build_times.shading);
+
+        caustics = nullptr;
+        if (caustic_photons > 0)
+        {
+            caustics = make_shared<photon_map>();
+            caustics->photon_count = caustic_photons;
+            if (caustics->build(world, lights, cam.seed) == 0)
+                caustics = nullptr; // Nothing to gather; leave the caustic paths to the path tracer
+        }
+        cam.caustics = caustics.get();
+        lap(build_times.photon_map);
+
+        guide = nullptr;
+        if (use_path_guiding)
+        {
+            guide = make_shared<path_guide>();
+            guide->initialize(world.bounding_box());
+        }
+        cam.guide = guide.get();
+
+        environment = nullptr;
+        if (!environment_map.empty())
+        {
+            environment = make_shared<environment_light>(environment_map, environment_intensity, environment_rotation);
+            if (!environment->build())
+                environment = nullptr; // Unreadable or black; the background color stays
+        }
+        cam.environment = environment.get();
+        cam.environment_share = lights.objects.empty() ? 1.0 : 0.5; /* 没有面光源时全部光源采样给环境图 */
+        lap(build_times.environment_map);
+    }
+
+    void train_guide()
+    {
+        // Teaches the path guide with short renders of 1, 2, 4, ... samples per pixel before the
+        // real one and drops their pixels. Renders that run in passes can skip this: their first
+        // passes train the guide as they go.
+        if (!guide)
+            return;
+        RT_TRACE_SCOPE("path guide");
+        auto c = cam;
+        c.show_progress = false;
+        c.tile_share = 0;
+        c.tile_share_count = 1;
+        std::vector<color> pixels;
+        for (int pass = 0; guide->learning(); pass++)
+        {
+            c.samples_per_pixel = 1 << pass;
+            c.seed = cam.seed + 0x10000 + pass; // Away from the seeds of the real passes
+            c.initialize();
+            c.render_image(world, *light_set, pixels);
+        }
+    }
+
+    const hittable &light_sampler() const { return *light_set; } /* build()之后有效 */
+
+    void render()
+    {
+        build();
+        train_guide();
+        cam.render(world, *light_set);
+    }
+
+private:
+    shared_ptr<hittable> light_set;
+    shared_ptr<shading_table> shading;
+    shared_ptr<photon_map> caustics;
+    shared_ptr<path_guide> guide;
+    shared_ptr<environment_light> environment;
+};
+
+inline scene bouncing_spheres()
+{
+    scene s;
+
+    auto checker = s.make<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    s.world.add(s.make<sphere>(point3(0, -1000, 0), 1000, s.make<lambertian>(checker)));
+
+    for (int a = -11; a < 11; a++)
+    {
+        for (int b = -11; b < 11; b++)
+        {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9)
+            {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8)
+                {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = s.make<lambertian>(albedo);
+                    auto center2 = center + vec3(0, random_double(0, .5), 0);
+                    s.world.add(s.make<sphere>(center, center2, 0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95)
+                {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = s.make<metal>(albedo, fuzz);
+                    s.world.add(s.make<sphere>(center, 0.2, sphere_material));
+                }
+                else
+                {
+                    // glass
+                    sphere_material = s.make<dielectric>(1.5);
+                    s.world.add(s.make<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = s.make<dielectric>(1.5);
+    s.world.add(s.make<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = s.make<lambertian>(color(0.4, 0.2, 0.1));
+    s.world.add(s.make<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = s.make<metal>(color(0.7, 0.6, 0.5), 0.0);
+    s.world.add(s.make<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(13, 2, 3);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0.6;
+    s.cam.focus_dist = 10.0;
+
+    return s;
+}
+
+inline scene checkered_spheres()
+{
+    scene s;
+
+    auto checker = s.make<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+
+    s.world.add(s.make<sphere>(point3(0, -10, 0), 10, s.make<lambertian>(checker)));
+    s.world.add(s.make<sphere>(point3(0, 10, 0), 10, s.make<lambertian>(checker)));
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(13, 2, 3);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+static const char *const earth_image = "../resource/earthmap.jpg";
+
+inline scene earth()
+{
+    scene s;
+
+    auto earth_texture = s.make<image_texture>(earth_image);
+    auto earth_surface = s.make<lambertian>(earth_texture);
+    auto globe = s.make<sphere>(point3(0, 0, 0), 2, earth_surface);
+    s.world.add(globe);
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(0, 0, 12);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene perlin_spheres()
+{
+    scene s;
+
+    auto pertext = s.make<noise_texture>(4);
+    s.world.add(s.make<sphere>(point3(0, -1000, 0), 1000, s.make<lambertian>(pertext)));
+    s.world.add(s.make<sphere>(point3(0, 2, 0), 2, s.make<lambertian>(pertext)));
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(13, 2, 3);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene quads()
+{
+    scene s;
+
+    // Materials
+    auto left_red = s.make<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green = s.make<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue = s.make<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = s.make<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal = s.make<lambertian>(color(0.2, 0.8, 0.8));
+
+    // Quads
+    s.world.add(s.make<quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
+    s.world.add(s.make<quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
+    s.world.add(s.make<quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
+    s.world.add(s.make<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
+    s.world.add(s.make<quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 80;
+    s.cam.lookfrom = point3(0, 0, 9);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene simple_light()
+{
+    scene s;
+
+    auto pertext = s.make<noise_texture>(4);
+    s.world.add(s.make<sphere>(point3(0, -1000, 0), 1000, s.make<lambertian>(pertext)));
+    s.world.add(s.make<sphere>(point3(0, 2, 0), 2, s.make<lambertian>(pertext)));
+
+    auto difflight = s.make<diffuse_light>(color(4, 4, 4));
+    auto light_sphere = s.make<sphere>(point3(0, 7, 0), 2, difflight);
+    auto light_quad = s.make<quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight);
+    s.world.add(light_sphere);
+    s.world.add(light_quad);
+    s.lights.add(light_sphere);
+    s.lights.add(light_quad);
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(26, 3, 6);
+    s.cam.lookat = point3(0, 2, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene cornell_box()
+{
+    scene s;
+
+    auto red = s.make<lambertian>(color(.65, .05, .05));
+    auto white = s.make<lambertian>(color(.73, .73, .73));
+    auto green = s.make<lambertian>(color(.12, .45, .15));
+    auto light = s.make<diffuse_light>(color(15, 15, 15));
+
+    s.world.add(s.make<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    auto light_quad = s.make<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light);
+    s.world.add(light_quad);
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    // Box
+    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white, &s.arena());
+    box1 = s.make<rotate_y>(box1, 15);
+    box1 = s.make<translate>(box1, vec3(265, 0, 295));
+    s.world.add(box1);
+
+    // Glass Sphere
+    auto glass = s.make<dielectric>(1.5);
+    auto glass_sphere = s.make<sphere>(point3(190, 90, 190), 90, glass);
+    s.world.add(glass_sphere);
+
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 600;
+    s.cam.samples_per_pixel = 1000;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(278, 278, -800);
+    s.cam.lookat = point3(278, 278, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    s.lights.add(light_quad); /* 光源和球体 */
+    s.lights.add(glass_sphere);
+    s.use_light_bvh = true;
+
+    return s;
+}
+
+inline scene cornell_smoke()
+{
+    scene s;
+
+    auto red = s.make<lambertian>(color(.65, .05, .05));
+    auto white = s.make<lambertian>(color(.73, .73, .73));
+    auto green = s.make<lambertian>(color(.12, .45, .15));
+    auto light = s.make<diffuse_light>(color(7, 7, 7));
+
+    s.world.add(s.make<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    auto light_quad = s.make<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light);
+    s.world.add(light_quad);
+    s.world.add(s.make<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white, &s.arena());
+    box1 = s.make<rotate_y>(box1, 15);
+    box1 = s.make<translate>(box1, vec3(265, 0, 295));
+
+    shared_ptr<hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white, &s.arena());
+    box2 = s.make<rotate_y>(box2, -18);
+    box2 = s.make<translate>(box2, vec3(130, 0, 65));
+
+    s.world.add(s.make<constant_medium>(box1, 0.01, color(0, 0, 0)));
+    s.world.add(s.make<constant_medium>(box2, 0.01, color(1, 1, 1)));
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 200;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(278, 278, -800);
+    s.cam.lookat = point3(278, 278, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    s.lights.add(light_quad);
+
+    return s;
+}
+
+inline scene cornell_cloud()
+{
+    scene s;
+
+    auto red = s.make<lambertian>(color(.65, .05, .05));
+    auto white = s.make<lambertian>(color(.73, .73, .73));
+    auto green = s.make<lambertian>(color(.12, .45, .15));
+    auto light = s.make<diffuse_light>(color(7, 7, 7));
+
+    s.world.add(s.make<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    auto light_quad = s.make<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light);
+    s.world.add(light_quad);
+    s.world.add(s.make<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    // Turbulent density inside a soft sphere, sampled into a 64^3 voxel grid.
+    perlin noise;
+    auto cloud = s.make<density_grid>(64, 64, 64, [&](const point3 &p)
+                                           {
+        auto falloff = 1 - 2 * (p - point3(0.5, 0.5, 0.5)).length();
+        return falloff <= 0 ? 0.0 : falloff * noise.turb(4 * p, 7); });
+    s.world.add(s.make<grid_medium>(cloud, aabb(point3(128, 60, 128), point3(428, 360, 428)), 0.05, color(1, 1, 1)));
+
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 200;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(278, 278, -800);
+    s.cam.lookat = point3(278, 278, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    s.lights.add(light_quad);
+
+    return s;
+}
+
+// Synthetic stress scenes for the benchmark: large primitive counts and many lights.
+
+inline scene sphere_field()
+{
+    // 40000 small spheres on a plane: BVH build and traversal dominate.
+    scene s;
+
+    auto ground = s.make<lambertian>(color(0.5, 0.5, 0.5));
+    s.world.add(s.make<sphere>(point3(0, -1000, 0), 1000, ground));
+
+    for (int a = -100; a < 100; a++)
+    {
+        for (int b = -100; b < 100; b++)
+        {
+            point3 center(0.5 * a + 0.3 * random_double(), 0.1, 0.5 * b + 0.3 * random_double());
+            shared_ptr<material> sphere_material;
+            if (random_double() < 0.8)
+                sphere_material = s.make<lambertian>(color::random() * color::random());
+            else
+                sphere_material = s.make<metal>(color::random(0.5, 1), random_double(0, 0.5));
+            s.world.add(s.make<sphere>(center, 0.1, sphere_material));
+        }
+    }
+
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 30;
+    s.cam.lookfrom = point3(30, 8, 30);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene quad_soup()
+{
+    // 20000 randomly oriented quads inside a lit box: deep, overlapping BVH nodes.
+    scene s;
+
+    auto white = s.make<lambertian>(color(.73, .73, .73));
+    auto light = s.make<diffuse_light>(color(15, 15, 15));
+
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+    auto light_quad = s.make<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light);
+    s.world.add(light_quad);
+    s.lights.add(light_quad);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        auto q = point3(random_double(50, 500), random_double(20, 500), random_double(50, 500));
+        auto albedo = s.make<lambertian>(color::random(0.2, 0.9));
+        s.world.add(s.make<quad>(q, 10 * random_unit_vector(), 10 * random_unit_vector(), albedo));
+    }
+
+    s.use_bvh = true;
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(278, 278, -800);
+    s.cam.lookat = point3(278, 278, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline scene many_lights()
+{
+    // A 32x32 grid of small area lights over a cornell floor: light selection dominates.
+    scene s;
+
+    auto white = s.make<lambertian>(color(.73, .73, .73));
+    s.world.add(s.make<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    s.world.add(s.make<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    for (int a = 0; a < 32; a++)
+    {
+        for (int b = 0; b < 32; b++)
+        {
+            auto light = s.make<diffuse_light>(color::random(2, 20));
+            auto light_quad = s.make<quad>(point3(10 + 17 * a, 554, 10 + 17 * b), vec3(8, 0, 0), vec3(0, 0, 8), light);
+            s.world.add(light_quad);
+            s.lights.add(light_quad);
+        }
+    }
+
+    for (int i = 0; i < 64; i++)
+    {
+        auto center = point3(random_double(40, 515), random_double(20, 200), random_double(40, 515));
+        s.world.add(s.make<sphere>(center, random_double(10, 30), white));
+    }
+
+    s.use_bvh = true;
+    s.use_light_bvh = true;
+
+    s.cam.aspect_ratio = 1.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0, 0, 0);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(278, 278, -800);
+    s.cam.lookat = point3(278, 278, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+struct scene_entry
+{
+    std::string name;
+    std::function<scene()> builder;
+    bool synthetic; /* 合成的压力测试场景 */
+    std::vector<std::string> files = {}; // Files the builder reads, so caches notice when they change
+
+    scene make() const
+    {
+        RT_TRACE_SCOPE("scene load");
+        return builder();
+    }
+};
+
+static const char *const mesh_terrain_file = "mesh_terrain.rtmesh";
+
+inline scene mesh_terrain()
+{
+    // A 512x512 heightfield (524288 triangles) traversed straight from a memory-mapped mesh file.
+    // The file is written to the current directory the first time, or whenever the one there
+    // does not map, and reused afterwards, so later runs measure the cold start of a mapped mesh.
+    scene s;
+
+    const std::string filename = mesh_terrain_file;
+    auto ground = s.make<lambertian>(color(0.45, 0.55, 0.35));
+    shared_ptr<mapped_mesh> mesh;
+    if (std::ifstream(filename))
+        mesh = s.make<mapped_mesh>(filename, ground);
+    if (!mesh || !mesh->valid())
+    {
+        const int n = 512;
+        auto height = [](double x, double z)
+        { return 1.5 * std::sin(0.7 * x) * std::cos(0.5 * z) + 0.3 * std::sin(3 * x + 2 * z); };
+        auto vertex = [&](int i, int j)
+        {
+            auto x = -10 + 20.0 * i / n, z = -10 + 20.0 * j / n;
+            return point3(x, height(x, z), z);
+        };
+        std::vector<mesh_triangle> triangles;
+        triangles.reserve(2 * n * n);
+        for (int j = 0; j < n; j++)
+            for (int i = 0; i < n; i++)
+            {
+                triangles.push_back({vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1)});
+                triangles.push_back({vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1)});
+            }
+        write_mesh_file(filename, triangles);
+        mesh = s.make<mapped_mesh>(filename, ground);
+    }
+    s.world.add(mesh);
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pixel = 100;
+    s.cam.max_depth = 50;
+    s.cam.background = color(0.70, 0.80, 1.00);
+
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(14, 9, 14);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.vup = vec3(0, 1, 0);
+
+    s.cam.defocus_angle = 0;
+
+    return s;
+}
+
+inline const std::vector<scene_entry> &scene_registry()
+{
+    static const std::vector<scene_entry> entries = {
+        {"bouncing_spheres", bouncing_spheres, false},
+        {"checkered_spheres", checkered_spheres, false},
+        {"earth", earth, false, {earth_image}},
+        {"perlin_spheres", perlin_spheres, false},
+        {"quads", quads, false},
+        {"simple_light", simple_light, false},
+        {"cornell_box", cornell_box, false},
+        {"cornell_smoke", cornell_smoke, false},
+        {"cornell_cloud", cornell_cloud, false},
+        {"sphere_field", sphere_field, true},
+        {"quad_soup", quad_soup, true},
+        {"many_lights", many_lights, true},
+        {"mesh_terrain", mesh_terrain, true, {mesh_terrain_file}},
+    };
+    return entries;
+}
+
+inline const scene_entry *find_scene(const std::string &name)
+{
+    for (const auto &entry : scene_registry())
+        if (entry.name == name)
+            return &entry;
+    return nullptr;
+}
+
+#endif
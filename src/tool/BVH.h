@@ -5,6 +5,8 @@
 #include "../obj/hittable.h"
 #include "../obj/hittable_list.h"
 
+#include <algorithm>
+
 class bvh_node : public hittable
 {
 public:
@@ -45,12 +47,14 @@ public:
             right = make_shared<bvh_node>(objects, mid, end);
         }
 
-        bbox = aabb(left->bounding_box(), right->bounding_box());
+        update_bounds();
+        build_cost = cost = sah_cost();
     }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
-        if (!bbox.hit(r, ray_t))
+        RT_STAT(bvh_nodes_visited);
+        if (moving ? !aabb::lerp(bbox0, bbox1, r.time()).hit(r, ray_t) : !bbox.hit(r, ray_t))
             return false;
 
         bool hit_left = left->hit(r, ray_t, rec);
@@ -60,17 +64,121 @@ public:
     }
 
     aabb bounding_box() const override { return bbox; }
+    aabb bounding_box_at(double time) const override { return moving ? aabb::lerp(bbox0, bbox1, time) : bbox; }
+
+    void for_each_child(const std::function<void(const hittable &)> &visit) const override
+    {
+        visit(*left);
+        if (right != left) // A one-object node holds it twice
+            visit(*right);
+    }
+
+    void refit() override
+    {
+        // Refit every box bottom-up in O(n), then rebuild only the topmost subtrees whose SAH cost
+        // grew past rebuild_threshold times the cost they had when they were built.
+        refit_bounds();
+        rebuild_degraded();
+    }
+
+    static constexpr double rebuild_threshold = 1.5; /* SAH代价增长超过该比例时重建子树 */
 
 private:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
-    aabb bbox;
+    aabb bbox;         /* 整个快门时间内的包围盒 */
+    aabb bbox0, bbox1; /* time = 0 和 time = 1 时的包围盒 */
+    bool moving;
+    double cost;       /* 当前SAH代价 */
+    double build_cost; /* 构建时的SAH代价 */
+
+    void update_bounds()
+    {
+        bbox = aabb(left->bounding_box(), right->bounding_box());
+
+        // Bounds at both ends of the shutter interval. For linearly moving children the box
+        // interpolated between them at any ray time still encloses everything below this node.
+        bbox0 = aabb(left->bounding_box_at(0), right->bounding_box_at(0));
+        bbox1 = aabb(left->bounding_box_at(1), right->bounding_box_at(1));
+        moving = !same_box(bbox0, bbox1);
+    }
+
+    double sah_cost() const
+    {
+        // Expected number of node visits plus primitive tests for a ray that enters this node,
+        // counting each non-BVH child as one primitive test.
+        auto area = surface_area(bbox);
+        auto child_cost = [&](const shared_ptr<hittable> &child)
+        {
+            auto node = dynamic_cast<const bvh_node *>(child.get());
+            auto c = node ? node->cost : 1.0;
+            return area > 0 ? c * surface_area(child->bounding_box()) / area : c;
+        };
+        return 1.0 + child_cost(left) + (right == left ? 0.0 : child_cost(right));
+    }
+
+    void refit_bounds()
+    {
+        for (auto child : {left, right == left ? nullptr : right})
+        {
+            if (!child)
+                continue;
+            if (auto node = dynamic_cast<bvh_node *>(child.get()))
+                node->refit_bounds();
+            else
+                child->refit();
+        }
+        update_bounds();
+        cost = sah_cost();
+    }
+
+    void rebuild_degraded()
+    {
+        if (cost > rebuild_threshold * build_cost)
+        {
+            std::vector<shared_ptr<hittable>> objects;
+            collect(objects);
+            *this = bvh_node(objects, 0, objects.size());
+            return;
+        }
+
+        for (auto child : {left, right})
+            if (auto node = dynamic_cast<bvh_node *>(child.get()))
+                node->rebuild_degraded();
+    }
+
+    void collect(std::vector<shared_ptr<hittable>> &objects) const /* 收集子树中的所有图元 */
+    {
+        for (auto child : {left, right == left ? nullptr : right})
+        {
+            if (!child)
+                continue;
+            if (auto node = dynamic_cast<const bvh_node *>(child.get()))
+                node->collect(objects);
+            else
+                objects.push_back(child);
+        }
+    }
+
+    static double surface_area(const aabb &box)
+    {
+        auto dx = box.x.size(), dy = box.y.size(), dz = box.z.size();
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    static bool same_box(const aabb &a, const aabb &b)
+    {
+        return a.x.min == b.x.min && a.x.max == b.x.max && a.y.min == b.y.min && a.y.max == b.y.max &&
+               a.z.min == b.z.min && a.z.max == b.z.max;
+    }
 
     static bool box_compare(
         const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index) /* 给定两个物体，沿着axis_index方向排序 */
     {
-        auto a_axis_interval = a->bounding_box().axis_interval(axis_index);
-        auto b_axis_interval = b->bounding_box().axis_interval(axis_index);
+        // Order moving objects by where they are at mid-shutter, not by their swept boxes, so
+        // siblings stay close together at every ray time.
+        auto a_axis_interval = a->bounding_box_at(0.5).axis_interval(axis_index);
+        auto b_axis_interval = b->bounding_box_at(0.5).axis_interval(axis_index);
         return a_axis_interval.min < b_axis_interval.min;
     }
 
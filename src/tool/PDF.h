@@ -4,6 +4,8 @@
 #include "onb.h"
 #include "../obj/hittable_list.h"
 
+#include <variant>
+
 class pdf
 {
 public:
@@ -12,7 +14,7 @@ public:
     virtual double value(const vec3 &direction) const = 0; /* 此方向PDF的值 */
     virtual vec3 generate() const = 0;                     /* 反射方向 */
 };
-class sphere_pdf : public pdf /* 均等PDF */
+class sphere_pdf final : public pdf /* 均等PDF */
 {
 public:
     sphere_pdf() {}
@@ -27,7 +29,7 @@ public:
         return random_unit_vector(); /* 单位球体方向 */
     }
 };
-class cosine_pdf : public pdf /* 余弦PDF */
+class cosine_pdf final : public pdf /* 余弦PDF */
 {
 public:
     cosine_pdf(const vec3 &w) : uvw(w) {}
@@ -46,6 +48,31 @@ public:
 private:
     onb uvw;
 };
+// A surface pdf held by value, so closed-world shading (render/shading_table.h) samples and
+// evaluates it without an allocation or an indirect call; the alternatives are final classes,
+// which lets std::visit call them directly.
+class closed_pdf
+{
+public:
+    closed_pdf() {}
+    closed_pdf(const sphere_pdf &p) : p(p) {}
+    closed_pdf(const cosine_pdf &p) : p(p) {}
+
+    double value(const vec3 &direction) const
+    {
+        return std::visit([&direction](const auto &p)
+                          { return p.value(direction); }, p);
+    }
+
+    vec3 generate() const
+    {
+        return std::visit([](const auto &p)
+                          { return p.generate(); }, p);
+    }
+
+private:
+    std::variant<sphere_pdf, cosine_pdf> p;
+};
 class hittable_pdf : public pdf
 {
 public:
@@ -59,11 +86,21 @@ public:
         return objects.pdf_value(origin, direction); /* p(direction) = distance(p,q)^2 / (cosα * A) */
     }
 
+    double value(const vec3 &direction, const hit_record &rec) const /* 已知该方向的交点，无需再次求交 */
+    {
+        return objects.hit_pdf_value(origin, direction, rec);
+    }
+
     vec3 generate() const override
     {
         return objects.random(origin); /* 大体反射方向是：交点-》光源，有random变化 */
     }
 
+    vec3 generate(const hittable *&sampled) const /* 同时返回被采样的光源图元 */
+    {
+        return objects.random(origin, sampled);
+    }
+
 private:
     const hittable &objects;
     point3 origin;
@@ -82,6 +119,11 @@ public:
         return 0.5 * p[0]->value(direction) + 0.5 * p[1]->value(direction);
     }
 
+    double value(double p0_value, const vec3 &direction) const /* p[0]的值已由调用者求出 */
+    {
+        return 0.5 * p0_value + 0.5 * p[1]->value(direction);
+    }
+
     vec3 generate() const override
     {
         if (random_double() < 0.5)
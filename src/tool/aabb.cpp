@@ -1,6 +1,8 @@
 #include "aabb.h"
-const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+// Built from the interval constructors rather than interval::empty/universe: those live in another
+// translation unit and may still be zero here, which made aabb::empty a tiny box at the origin.
+const aabb aabb::empty = aabb();
+const aabb aabb::universe = aabb(interval(-infinity, +infinity), interval(-infinity, +infinity), interval(-infinity, +infinity));
 
 aabb operator+(const aabb &bbox, const vec3 &offset)
 {
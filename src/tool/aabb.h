@@ -3,6 +3,7 @@
 
 #include "interval.h"
 #include "../render/ray.h"
+#include "stats.h"
 
 /* 轴对齐包围盒 */
 class aabb
@@ -42,6 +43,12 @@ public:
 
     bool hit(const ray &r, interval ray_t) const /* 光线和包围盒求交 */
     {
+        return clip(r, ray_t);
+    }
+
+    bool clip(const ray &r, interval &ray_t) const /* 求交，并把ray_t收缩为光线在盒内的区间 */
+    {
+        RT_STAT(box_tests);
         const point3 &ray_orig = r.origin();
         const vec3 &ray_dir = r.direction();
 
@@ -82,6 +89,16 @@ public:
             return y.size() > z.size() ? 1 : 2;
     }
 
+    static aabb lerp(const aabb &box0, const aabb &box1, double t) /* 在两个时刻的包围盒之间线性插值 */
+    {
+        // Both inputs are already padded, so skip pad_to_minimums.
+        aabb box;
+        box.x = interval(box0.x.min + t * (box1.x.min - box0.x.min), box0.x.max + t * (box1.x.max - box0.x.max));
+        box.y = interval(box0.y.min + t * (box1.y.min - box0.y.min), box0.y.max + t * (box1.y.max - box0.y.max));
+        box.z = interval(box0.z.min + t * (box1.z.min - box0.z.min), box0.z.max + t * (box1.z.max - box0.z.max));
+        return box;
+    }
+
     static const aabb empty, universe;
 
 private:
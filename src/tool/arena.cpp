@@ -0,0 +1 @@
+#include "arena.h"
\ No newline at end of file
@@ -0,0 +1,150 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "rtweekend.h"
+
+#include <memory>
+#include <new>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* 场景内存池：同类对象连续存放，随场景一次释放 */
+// Storage for the objects of one scene: primitives, materials, textures and instances. Every
+// type gets its own pool of blocks that double in size, so objects of a type sit next to each
+// other in creation order instead of scattered over the heap, and each can be found again by its
+// index in the pool. Nothing is freed one by one: the pools run the destructors and release their
+// blocks when the arena is cleared or destroyed.
+//
+// make() hands out shared_ptrs that alias an empty owner. They point into the arena without a
+// control block, so creating and copying them never touches a reference count, and the objects
+// can keep referring to each other through the usual shared_ptr members. The flip side is that
+// they do not keep anything alive: the arena must outlive every pointer it handed out.
+
+class scene_arena
+{
+public:
+    scene_arena() {}
+    ~scene_arena() { clear(); }
+
+    scene_arena(const scene_arena &) = delete;
+    scene_arena &operator=(const scene_arena &) = delete;
+
+    template <class T, class... Args>
+    shared_ptr<T> make(Args &&...args)
+    {
+        T *object = pool<T>().emplace(std::forward<Args>(args)...);
+        return shared_ptr<T>(shared_ptr<T>(), object);
+    }
+
+    template <class T>
+    size_t count() const
+    {
+        auto found = pools.find(std::type_index(typeid(T)));
+        return found == pools.end() ? 0 : found->second->size;
+    }
+
+    template <class T>
+    T &at(size_t index) { return pool<T>()[index]; } // index < count<T>(), in creation order
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (const auto *p : order)
+            total += p->bytes();
+        return total;
+    }
+
+    void clear()
+    {
+        // Later pools may refer to earlier ones (a sphere to its material), so tear down backwards.
+        for (auto p = order.rbegin(); p != order.rend(); ++p)
+            (*p)->clear();
+        order.clear();
+        pools.clear();
+    }
+
+private:
+    struct pool_base
+    {
+        size_t size = 0;
+        virtual ~pool_base() {}
+        virtual void clear() = 0;
+        virtual size_t bytes() const = 0;
+    };
+
+    template <class T>
+    struct typed_pool : pool_base
+    {
+        static const size_t first_block = 16; // Block b holds first_block << b objects
+        std::vector<T *> blocks;
+        size_t used = 0; // Objects in the last block
+
+        ~typed_pool() override { clear(); }
+
+        template <class... Args>
+        T *emplace(Args &&...args)
+        {
+            if (blocks.empty() || used == capacity(blocks.size() - 1))
+            {
+                blocks.push_back(std::allocator<T>().allocate(capacity(blocks.size())));
+                used = 0;
+            }
+            T *object = new (blocks.back() + used) T(std::forward<Args>(args)...);
+            used++; // Only once constructed, so a throwing constructor leaves nothing behind
+            this->size++;
+            return object;
+        }
+
+        T &operator[](size_t index)
+        {
+            size_t b = 0;
+            while (index >= capacity(b))
+                index -= capacity(b++);
+            return blocks[b][index];
+        }
+
+        void clear() override
+        {
+            for (size_t b = blocks.size(); b-- > 0;)
+            {
+                size_t n = b + 1 == blocks.size() ? used : capacity(b);
+                while (n-- > 0)
+                    blocks[b][n].~T();
+                std::allocator<T>().deallocate(blocks[b], capacity(b));
+            }
+            blocks.clear();
+            used = 0;
+            this->size = 0;
+        }
+
+        size_t bytes() const override
+        {
+            size_t total = 0;
+            for (size_t b = 0; b < blocks.size(); b++)
+                total += capacity(b) * sizeof(T);
+            return total;
+        }
+
+        static size_t capacity(size_t block) { return first_block << block; }
+    };
+
+    std::unordered_map<std::type_index, std::unique_ptr<pool_base>> pools;
+    std::vector<pool_base *> order; // Pools in creation order
+
+    template <class T>
+    typed_pool<T> &pool()
+    {
+        auto &slot = pools[std::type_index(typeid(T))];
+        if (!slot)
+        {
+            slot.reset(new typed_pool<T>());
+            order.push_back(slot.get());
+        }
+        return static_cast<typed_pool<T> &>(*slot);
+    }
+};
+
+#endif
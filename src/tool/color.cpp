@@ -8,7 +8,7 @@ inline double linear_to_gamma(double linear_component)
     return 0;
 }
 
-void write_color(std::ostream &out, const color &pixel_color)
+void color_to_bytes(const color &pixel_color, unsigned char rgb[3])
 {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
@@ -28,10 +28,16 @@ void write_color(std::ostream &out, const color &pixel_color)
 
     // Translate the [0,1] component values to the byte range [0,255].
     static const interval intensity(0.000, 0.999);
-    int rbyte = int(256 * intensity.clamp(r));
-    int gbyte = int(256 * intensity.clamp(g));
-    int bbyte = int(256 * intensity.clamp(b));
+    rgb[0] = (unsigned char)(256 * intensity.clamp(r));
+    rgb[1] = (unsigned char)(256 * intensity.clamp(g));
+    rgb[2] = (unsigned char)(256 * intensity.clamp(b));
+}
+
+void write_color(std::ostream &out, const color &pixel_color)
+{
+    unsigned char rgb[3];
+    color_to_bytes(pixel_color, rgb);
 
     // Write out the pixel color components.
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
-}
\ No newline at end of file
+    out << int(rgb[0]) << ' ' << int(rgb[1]) << ' ' << int(rgb[2]) << '\n';
+}
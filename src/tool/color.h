@@ -10,4 +10,7 @@ using color = vec3;
 
 void write_color(std::ostream &out, const color &pixel_color);
 
+// The gamma-encoded 8-bit components write_color prints for a pixel.
+void color_to_bytes(const color &pixel_color, unsigned char rgb[3]);
+
 #endif
\ No newline at end of file
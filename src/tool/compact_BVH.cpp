@@ -0,0 +1 @@
+#include "compact_BVH.h"
\ No newline at end of file
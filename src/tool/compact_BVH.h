@@ -0,0 +1,259 @@
+#ifndef COMPACT_BVH_H
+#define COMPACT_BVH_H
+
+#include "aabb.h"
+#include "../obj/hittable.h"
+#include "../obj/hittable_list.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* 压缩的四叉BVH：子节点包围盒相对父节点量化为8位 */
+// A 4-wide BVH in one flat array of 64-byte nodes. Each node stores its own box as a float origin
+// and a per-axis scale, and the boxes of its up to four children as 8-bit offsets on that grid,
+// rounded outwards so the decoded boxes always enclose the real ones. Compared with bvh_node
+// (three double aabbs, two shared_ptrs and a heap block per binary node) the tree takes about a
+// tenth of the memory, and one cache line answers the box tests of four children.
+//
+// The split is the same median split as bvh_node's, two levels at a time, so the two trees differ
+// only in their layout. Moving objects are bounded by their whole-shutter box.
+class compact_bvh : public hittable
+{
+public:
+    compact_bvh(hittable_list list) : compact_bvh(list.objects) {}
+
+    compact_bvh(const std::vector<shared_ptr<hittable>> &list) : objects(list)
+    {
+        if (objects.empty())
+            return;
+        nodes.reserve(objects.size() / 2 + 1);
+        build(0, objects.size());
+        bbox = range_box(0, objects.size());
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (nodes.empty())
+            return false;
+
+        const double origin[3] = {r.origin().x(), r.origin().y(), r.origin().z()};
+        const double inv[3] = {1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z()};
+        std::uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        bool hit_anything = false;
+
+        while (top > 0)
+        {
+            const auto &n = nodes[stack[--top]];
+            RT_STAT(bvh_nodes_visited);
+
+            // Decode and slab-test all four children at once; the fixed-width lane loops are
+            // written so the compiler can vectorize them.
+            double t_near[4], t_far[4];
+            for (int k = 0; k < 4; k++)
+            {
+                t_near[k] = ray_t.min;
+                t_far[k] = ray_t.max;
+            }
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const double base = n.origin[axis] - origin[axis], scale = n.scale[axis], i = inv[axis];
+                for (int k = 0; k < 4; k++)
+                {
+                    auto t0 = (base + n.lo[axis][k] * scale) * i;
+                    auto t1 = (base + n.hi[axis][k] * scale) * i;
+                    t_near[k] = std::max(t_near[k], std::min(t0, t1));
+                    t_far[k] = std::min(t_far[k], std::max(t0, t1));
+                }
+            }
+
+            // Leaves are tested right away; inner children go on the stack farthest first.
+            int order[4], count = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                if (n.child[k] == empty_child)
+                    continue;
+                RT_STAT(box_tests);
+                if (t_near[k] > t_far[k])
+                    continue;
+                if (n.child[k] & leaf_flag)
+                {
+                    if (objects[n.child[k] & ~leaf_flag]->hit(r, ray_t, rec))
+                    {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                    continue;
+                }
+                int j = count++;
+                for (; j > 0 && t_near[order[j - 1]] < t_near[k]; j--)
+                    order[j] = order[j - 1];
+                order[j] = k;
+            }
+            for (int j = 0; j < count; j++)
+                if (t_near[order[j]] <= ray_t.max)
+                    stack[top++] = n.child[order[j]];
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    void refit() override
+    {
+        // Keeps the topology and recomputes the boxes in O(n), like bvh_node's refit: children
+        // always come after their parent in the array, so one backwards pass sees every child
+        // box before its node's, and each node is quantized again around its new box.
+        for (auto &object : objects)
+            object->refit();
+        if (nodes.empty())
+            return;
+        std::vector<aabb> node_box(nodes.size());
+        for (auto i = nodes.size(); i-- > 0;)
+        {
+            auto &n = nodes[i];
+            aabb child_box[4];
+            int children = 0;
+            auto box = aabb::empty;
+            for (; children < 4 && n.child[children] != empty_child; children++)
+            {
+                auto c = n.child[children];
+                child_box[children] = c & leaf_flag ? objects[c & ~leaf_flag]->bounding_box() : node_box[c];
+                box = aabb(box, child_box[children]);
+            }
+            encode(n, box, child_box, children);
+            node_box[i] = box;
+        }
+        bbox = node_box[0];
+    }
+
+    void for_each_child(const std::function<void(const hittable &)> &visit) const override
+    {
+        for (const auto &object : objects)
+            visit(*object);
+    }
+
+    size_t node_count() const { return nodes.size(); }
+    size_t memory_bytes() const { return nodes.size() * sizeof(node) + objects.size() * sizeof(objects[0]); }
+
+private:
+    static const std::uint32_t leaf_flag = 0x80000000u;
+    static const std::uint32_t empty_child = 0xffffffffu;
+
+    struct alignas(64) node
+    {
+        float origin[3];          // Lower corner of the node box, rounded down
+        float scale[3];           // Size of one quantization step per axis
+        std::uint8_t lo[3][4];    // Child box = origin + [lo, hi] * scale, per axis and child
+        std::uint8_t hi[3][4];
+        std::uint32_t child[4];   // Node index, leaf_flag | object index, or empty_child
+    };
+    static_assert(sizeof(node) == 64, "compact_bvh::node should fill one cache line");
+
+    std::vector<shared_ptr<hittable>> objects; // Reordered so each subtree is a contiguous range
+    std::vector<node> nodes;
+    aabb bbox;
+
+    std::uint32_t build(size_t start, size_t end)
+    {
+        auto index = std::uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        // Up to four child ranges: the two halves of the range, each halved once more.
+        size_t bounds[5] = {start, start, start, start, start};
+        int children = 0;
+        auto mid = split(start, end);
+        for (auto half : {std::make_pair(start, mid), std::make_pair(mid, end)})
+        {
+            if (half.second - half.first <= 1)
+            {
+                if (half.second > half.first)
+                    bounds[++children] = half.second;
+                continue;
+            }
+            auto quarter = split(half.first, half.second);
+            bounds[++children] = quarter;
+            bounds[++children] = half.second;
+        }
+
+        aabb child_box[4];
+        std::uint32_t child[4] = {empty_child, empty_child, empty_child, empty_child};
+        auto node_box = aabb::empty;
+        for (int k = 0; k < children; k++)
+        {
+            auto first = k == 0 ? start : bounds[k];
+            auto last = bounds[k + 1];
+            child_box[k] = range_box(first, last);
+            node_box = aabb(node_box, child_box[k]);
+            child[k] = last - first == 1 ? leaf_flag | std::uint32_t(first) : build(first, last);
+        }
+
+        auto &n = nodes[index]; // Taken after the recursion grew the vector
+        encode(n, node_box, child_box, children);
+        for (int k = 0; k < 4; k++)
+            n.child[k] = child[k];
+        return index;
+    }
+
+    size_t split(size_t start, size_t end)
+    {
+        // Median split along the longest axis of the range's box, like bvh_node.
+        if (end - start <= 1)
+            return end;
+        int axis = range_box(start, end).longest_axis();
+        auto mid = start + (end - start) / 2;
+        std::nth_element(objects.begin() + start, objects.begin() + mid, objects.begin() + end,
+                         [axis](const shared_ptr<hittable> &a, const shared_ptr<hittable> &b)
+                         { return a->bounding_box_at(0.5).axis_interval(axis).min < b->bounding_box_at(0.5).axis_interval(axis).min; });
+        return mid;
+    }
+
+    aabb range_box(size_t start, size_t end) const
+    {
+        auto box = aabb::empty;
+        for (auto k = start; k < end; k++)
+            box = aabb(box, objects[k]->bounding_box());
+        return box;
+    }
+
+    static void encode(node &n, const aabb &box, const aabb child_box[4], int children)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const auto &extent = box.axis_interval(axis);
+            auto origin = float(extent.min);
+            if (origin > extent.min)
+                origin = std::nextafter(origin, -INFINITY);
+
+            // A power-of-two step with 254 steps covering the box leaves room for rounding.
+            auto size = extent.max - origin;
+            auto scale = size > 0 ? std::ldexp(1.0f, int(std::ceil(std::log2(size / 254)))) : 1.0f;
+            n.origin[axis] = origin;
+            n.scale[axis] = scale;
+
+            for (int k = 0; k < 4; k++)
+            {
+                if (k >= children)
+                {
+                    n.lo[axis][k] = 255, n.hi[axis][k] = 0; // Never hit
+                    continue;
+                }
+                const auto &c = child_box[k].axis_interval(axis);
+                auto lo = std::floor((c.min - origin) / scale);
+                auto hi = std::ceil((c.max - origin) / scale);
+                // Step outwards until the decoded bounds enclose the child exactly as doubles.
+                while (lo > 0 && origin + lo * double(scale) > c.min)
+                    lo--;
+                while (hi < 255 && origin + hi * double(scale) < c.max)
+                    hi++;
+                n.lo[axis][k] = std::uint8_t(std::max(0.0, lo));
+                n.hi[axis][k] = std::uint8_t(std::min(255.0, hi));
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,12 @@
+#include "light_BVH.h"
+#include "../render/material.h"
+
+double light_bvh::estimated_power(const hittable &light)
+{
+    hit_record rec;
+    auto area = light.sample_surface(rec);
+    if (area <= 0 || !rec.mat)
+        return 0;
+    auto le = rec.mat->emitted(ray(rec.p + rec.normal, -rec.normal), rec, rec.u, rec.v, rec.p);
+    return pi * area * (le.x() + le.y() + le.z()) / 3;
+}
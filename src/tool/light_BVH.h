@@ -0,0 +1,280 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include "aabb.h"
+#include "../obj/hittable.h"
+#include "../obj/hittable_list.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+/* 光源BVH：按功率/距离的重要性选择光源 */
+class light_bvh : public hittable
+{
+public:
+    light_bvh() {}
+
+    light_bvh(const hittable_list &lights) : light_bvh(lights.objects, std::vector<double>()) {}
+
+    light_bvh(const std::vector<shared_ptr<hittable>> &lights, const std::vector<double> &power)
+        : lights(lights)
+    {
+        // Without an explicit power, each light's power is estimated from its emission (see
+        // estimated_power). Members that do not emit, or cannot be sampled, such as a glass sphere
+        // kept in the list as a sampling target, get the mean power of the emitters, or the surface
+        // area of their bounding box when nothing emits.
+        double emitted_sum = 0;
+        int emitters = 0;
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            auto p = (i < power.size()) ? power[i] : estimated_power(*lights[i]);
+            light_power.push_back(std::fmax(p, 0.0));
+            if (i >= power.size() && p > 0)
+            {
+                emitted_sum += p;
+                emitters++;
+            }
+        }
+        for (size_t i = power.size(); i < lights.size(); i++)
+            if (light_power[i] <= 0)
+                light_power[i] = emitters > 0 ? emitted_sum / emitters : surface_area(lights[i]->bounding_box());
+
+        if (lights.empty())
+            return;
+
+        std::vector<int> indices(lights.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = int(i);
+
+        nodes.reserve(2 * lights.size());
+        build(indices, 0, indices.size(), -1);
+        bbox = nodes[0].bbox;
+    }
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        if (nodes.empty())
+            return false;
+
+        bool hit_anything = false;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const auto &n = nodes[stack[--top]];
+            if (!n.bbox.hit(r, ray_t))
+                continue;
+
+            if (n.light >= 0)
+            {
+                if (lights[n.light]->hit(r, ray_t, rec))
+                {
+                    hit_anything = true;
+                    ray_t.max = rec.t;
+                }
+                continue;
+            }
+            stack[top++] = n.left;
+            stack[top++] = n.right;
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    double pdf_value(const point3 &origin, const vec3 &direction) const override
+    {
+        // Sum of P(choose light) * pdf_light(direction) over every light the direction can reach.
+        // Only subtrees whose bounds the direction passes through can contribute, so this visits
+        // O(log n) nodes for typical scenes instead of intersecting every light.
+        if (nodes.empty())
+            return 0.0;
+
+        ray r(origin, direction);
+        auto ray_t = interval(0.001, infinity);
+        auto sum = 0.0;
+
+        int stack[64];
+        double stack_prob[64];
+        int top = 0;
+        stack[top] = 0;
+        stack_prob[top++] = 1.0;
+
+        while (top > 0)
+        {
+            top--;
+            const auto &n = nodes[stack[top]];
+            auto prob = stack_prob[top];
+            if (prob <= 0 || !n.bbox.hit(r, ray_t))
+                continue;
+
+            if (n.light >= 0)
+            {
+                sum += prob * lights[n.light]->pdf_value(origin, direction);
+                continue;
+            }
+
+            auto p_left = left_probability(n, origin);
+            stack[top] = n.left;
+            stack_prob[top++] = prob * p_left;
+            stack[top] = n.right;
+            stack_prob[top++] = prob * (1 - p_left);
+        }
+
+        return sum;
+    }
+
+    double hit_pdf_value(const point3 &origin, const vec3 &direction, const hit_record &rec) const override
+    {
+        // The traced ray already tells us which primitive it reached, so find that light's leaf and
+        // multiply the child-selection probabilities on the way back up to the root.
+        auto found = leaf_of.find(rec.object);
+        if (found == leaf_of.end())
+            return 0.0;
+
+        int leaf = found->second;
+        int index = leaf;
+        auto prob = 1.0;
+        for (int parent = nodes[index].parent; parent >= 0; index = parent, parent = nodes[parent].parent)
+        {
+            auto p_left = left_probability(nodes[parent], origin);
+            prob *= (nodes[parent].left == index) ? p_left : 1 - p_left;
+        }
+
+        return prob * lights[nodes[leaf].light]->hit_pdf_value(origin, direction, rec);
+    }
+
+    vec3 random(const point3 &origin) const override
+    {
+        const hittable *sampled;
+        return random(origin, sampled);
+    }
+
+    vec3 random(const point3 &origin, const hittable *&sampled) const override
+    {
+        sampled = nullptr;
+        if (nodes.empty())
+            return vec3(1, 0, 0);
+
+        // Walk down the tree, picking each child in proportion to its estimated contribution.
+        const node *n = &nodes[0];
+        while (n->light < 0)
+            n = (random_double() < left_probability(*n, origin)) ? &nodes[n->left] : &nodes[n->right];
+
+        return lights[n->light]->random(origin, sampled);
+    }
+
+    void refit() override
+    {
+        // Children are always stored after their parent, so a reverse sweep is bottom-up.
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            auto &n = nodes[i];
+            n.bbox = (n.light >= 0) ? lights[n.light]->bounding_box() : aabb(nodes[n.left].bbox, nodes[n.right].bbox);
+        }
+        if (!nodes.empty())
+            bbox = nodes[0].bbox;
+    }
+
+    size_t size() const { return lights.size(); }
+
+    // pi * area * mean radiance at one sampled surface point, the power a diffuse emitter sends
+    // out; 0 for objects without hittable::sample_surface or without emission.
+    static double estimated_power(const hittable &light);
+
+private:
+    struct node
+    {
+        aabb bbox;
+        double power; /* 子树总功率 */
+        int left = -1;
+        int right = -1;
+        int parent = -1;
+        int light = -1; /* 叶节点对应的光源下标，内部节点为-1 */
+    };
+
+    std::vector<shared_ptr<hittable>> lights;
+    std::vector<double> light_power;
+    std::vector<node> nodes;
+    std::unordered_map<const hittable *, int> leaf_of; /* 光源图元 -> 叶节点 */
+    aabb bbox;
+
+    int build(std::vector<int> &indices, size_t start, size_t end, int parent)
+    {
+        int index = int(nodes.size());
+        nodes.emplace_back();
+        nodes[index].parent = parent;
+
+        aabb node_box = aabb::empty;
+        aabb centroid_box = aabb::empty;
+        double power = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            auto light_box = lights[indices[i]]->bounding_box();
+            node_box = aabb(node_box, light_box);
+            centroid_box = aabb(centroid_box, aabb(centroid(light_box), centroid(light_box)));
+            power += light_power[indices[i]];
+        }
+        nodes[index].bbox = node_box;
+        nodes[index].power = power;
+
+        if (end - start == 1)
+        {
+            nodes[index].light = indices[start];
+            leaf_of[lights[indices[start]].get()] = index;
+            return index;
+        }
+
+        // Median split along the longest axis of the light centroids, like bvh_node.
+        int axis = centroid_box.longest_axis();
+        auto mid = start + (end - start) / 2;
+        std::nth_element(
+            std::begin(indices) + start, std::begin(indices) + mid, std::begin(indices) + end,
+            [&](int a, int b)
+            {
+                return centroid(lights[a]->bounding_box())[axis] < centroid(lights[b]->bounding_box())[axis];
+            });
+
+        int left = build(indices, start, mid, index);
+        int right = build(indices, mid, end, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    double importance(const node &n, const point3 &origin) const
+    {
+        // Power over squared distance to the cluster, clamped by the cluster's own radius so
+        // points inside or near a cluster don't blow up.
+        auto center = centroid(n.bbox);
+        auto half_diagonal = 0.5 * vec3(n.bbox.x.size(), n.bbox.y.size(), n.bbox.z.size());
+        auto distance_squared = (center - origin).length_squared();
+        return n.power / std::fmax(distance_squared, half_diagonal.length_squared());
+    }
+
+    double left_probability(const node &n, const point3 &origin) const
+    {
+        auto left = importance(nodes[n.left], origin);
+        auto right = importance(nodes[n.right], origin);
+        if (left + right <= 0)
+            return 0.5;
+        return left / (left + right);
+    }
+
+    static point3 centroid(const aabb &box)
+    {
+        return point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+    }
+
+    static double surface_area(const aabb &box)
+    {
+        auto dx = box.x.size(), dy = box.y.size(), dz = box.z.size();
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+#endif
@@ -10,11 +10,14 @@ double degrees_to_radians(double degrees)
     return degrees * pi / 180.0;
 }
 
+// Each thread owns its generator, so worker threads never share state. The main thread starts
+// from the default seed as before, which keeps randomly built scenes unchanged.
+static thread_local std::mt19937 generator;
+
 double random_double()
 {
     // Returns a random real in [0,1).
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
     return distribution(generator);
 }
 
@@ -22,4 +25,9 @@ double random_double(double min, double max)
 {
     // Returns a random real in [min,max).
     return min + (max - min) * random_double();
+}
+
+void seed_random(unsigned int seed)
+{
+    generator.seed(seed);
 }
\ No newline at end of file
@@ -26,6 +26,8 @@ double degrees_to_radians(double degrees);
 double random_double();
 
 double random_double(double min, double max);
+
+void seed_random(unsigned int seed); /* 重置当前线程的随机数序列 */
 // Common Headers
 inline int random_int(int min, int max)
 {
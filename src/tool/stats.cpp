@@ -0,0 +1,122 @@
+#include "stats.h"
+
+#ifdef RT_ENABLE_STATS
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+static std::mutex total_mutex;
+static render_stats total;
+
+void render_stats::merge(const render_stats &other)
+{
+    camera_rays += other.camera_rays;
+    scatter_rays += other.scatter_rays;
+    specular_rays += other.specular_rays;
+    ray_hits += other.ray_hits;
+    ray_misses += other.ray_misses;
+    bvh_nodes_visited += other.bvh_nodes_visited;
+    box_tests += other.box_tests;
+    for (int i = 0; i < stat_primitive_count; i++)
+    {
+        primitive_tests[i] += other.primitive_tests[i];
+        primitive_hits[i] += other.primitive_hits[i];
+    }
+    for (int i = 0; i <= max_path_length; i++)
+        path_lengths[i] += other.path_lengths[i];
+    max_depth_terminations += other.max_depth_terminations;
+    allocations += other.allocations;
+    tiles.insert(tiles.end(), other.tiles.begin(), other.tiles.end());
+}
+
+void render_stats::absorb(render_stats &counters)
+{
+    std::lock_guard<std::mutex> lock(total_mutex);
+    total.merge(counters);
+    counters = render_stats();
+}
+
+render_stats render_stats::collect()
+{
+    absorb(local());
+    std::lock_guard<std::mutex> lock(total_mutex);
+    return total;
+}
+
+void render_stats::reset()
+{
+    local() = render_stats();
+    std::lock_guard<std::mutex> lock(total_mutex);
+    total = render_stats();
+}
+
+static const char *primitive_names[stat_primitive_count] = {"sphere", "quad", "constant_medium", "grid_medium", "triangle"};
+
+static double ratio(long long a, long long b) { return b > 0 ? double(a) / b : 0.0; }
+
+void render_stats::print(std::ostream &out) const
+{
+    auto rays = camera_rays + scatter_rays + specular_rays;
+    long long paths = 0, bounces = 0;
+    for (int i = 0; i <= max_path_length; i++)
+    {
+        paths += path_lengths[i];
+        bounces += i * path_lengths[i];
+    }
+
+    out << "Render statistics\n";
+    out << "  Rays traced        " << rays << " (camera " << camera_rays << ", scatter " << scatter_rays
+        << ", specular " << specular_rays << ")\n";
+    out << "  Hits / misses      " << ray_hits << " / " << ray_misses << '\n';
+    out << "  BVH nodes visited  " << bvh_nodes_visited << " (" << ratio(bvh_nodes_visited, rays) << " per ray)\n";
+    out << "  Box tests          " << box_tests << " (" << ratio(box_tests, rays) << " per ray)\n";
+    for (int i = 0; i < stat_primitive_count; i++)
+        if (primitive_tests[i] > 0)
+            out << "  " << primitive_names[i] << " tests" << std::string(13 - std::string(primitive_names[i]).size(), ' ')
+                << primitive_tests[i] << " (" << 100 * ratio(primitive_hits[i], primitive_tests[i]) << "% hit)\n";
+    out << "  Paths              " << paths << " (mean length " << ratio(bounces, paths)
+        << ", cut at max_depth " << max_depth_terminations << ")\n";
+    out << "  Allocations        " << allocations << " (" << ratio(allocations, rays) << " per ray)\n";
+
+    if (!tiles.empty())
+    {
+        auto slowest = std::max_element(tiles.begin(), tiles.end(),
+                                        [](const tile_timing &a, const tile_timing &b)
+                                        { return a.ms < b.ms; });
+        double sum = 0, fastest = slowest->ms;
+        for (const auto &t : tiles)
+        {
+            sum += t.ms;
+            fastest = std::min(fastest, t.ms);
+        }
+        out << "  Tiles              " << tiles.size() << " (min " << fastest << " ms, mean " << sum / tiles.size()
+            << " ms, max " << slowest->ms << " ms at " << slowest->x << ',' << slowest->y << ")\n";
+    }
+}
+
+void render_stats::write_json(std::ostream &out) const
+{
+    out << "{\n";
+    out << "  \"rays\": {\"camera\": " << camera_rays << ", \"scatter\": " << scatter_rays
+        << ", \"specular\": " << specular_rays << ", \"hits\": " << ray_hits << ", \"misses\": " << ray_misses << "},\n";
+    out << "  \"bvh_nodes_visited\": " << bvh_nodes_visited << ",\n";
+    out << "  \"box_tests\": " << box_tests << ",\n";
+    out << "  \"primitives\": {";
+    for (int i = 0; i < stat_primitive_count; i++)
+        out << (i ? ", " : "") << '"' << primitive_names[i] << "\": {\"tests\": " << primitive_tests[i]
+            << ", \"hits\": " << primitive_hits[i] << '}';
+    out << "},\n";
+    out << "  \"path_lengths\": [";
+    for (int i = 0; i <= max_path_length; i++)
+        out << (i ? ", " : "") << path_lengths[i];
+    out << "],\n";
+    out << "  \"max_depth_terminations\": " << max_depth_terminations << ",\n";
+    out << "  \"allocations\": " << allocations << ",\n";
+    out << "  \"tiles\": [";
+    for (size_t i = 0; i < tiles.size(); i++)
+        out << (i ? ", " : "") << "{\"x\": " << tiles[i].x << ", \"y\": " << tiles[i].y << ", \"ms\": " << tiles[i].ms << '}';
+    out << "]\n}\n";
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Render statistics. Define RT_ENABLE_STATS (e.g. /DRT_ENABLE_STATS) to collect per-thread
+// counters on the hot paths; they are merged when a thread exits and reported after each render.
+// Without it every RT_STAT* macro expands to nothing and its arguments are never evaluated, so the
+// renderer compiles exactly as if the counters did not exist.
+
+#ifdef RT_ENABLE_STATS
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+enum stat_primitive /* 按图元类型统计求交测试 */
+{
+    stat_sphere,
+    stat_quad,
+    stat_constant_medium,
+    stat_grid_medium,
+    stat_triangle,
+    stat_primitive_count
+};
+
+class render_stats
+{
+public:
+    static const int max_path_length = 64; // Longer paths are counted in the last bucket
+
+    struct tile_timing
+    {
+        int x, y; // Upper left pixel
+        double ms;
+    };
+
+    // Rays by the reason they were traced, and whether they hit anything.
+    long long camera_rays = 0;
+    long long scatter_rays = 0;  // Sampled from the light/BSDF mixture
+    long long specular_rays = 0; // skip_pdf rays from metal and dielectric
+    long long ray_hits = 0;
+    long long ray_misses = 0;
+
+    // Acceleration structure work.
+    long long bvh_nodes_visited = 0;
+    long long box_tests = 0;
+
+    long long primitive_tests[stat_primitive_count] = {};
+    long long primitive_hits[stat_primitive_count] = {};
+
+    // path_lengths[n] counts paths that ended after n bounces.
+    long long path_lengths[max_path_length + 1] = {};
+    long long max_depth_terminations = 0;
+
+    long long allocations = 0; // Heap allocations on the shading path (pdf objects)
+
+    std::vector<tile_timing> tiles;
+
+    void end_path(int length) { path_lengths[length < max_path_length ? length : max_path_length]++; }
+
+    void merge(const render_stats &other);
+    void print(std::ostream &out) const;
+    void write_json(std::ostream &out) const;
+
+    // The calling thread's counters. Worker threads fold theirs into the total when they exit.
+    static render_stats &local();
+
+    // Folds the calling thread's counters into the total and returns a copy of the total.
+    static render_stats collect();
+    static void reset();
+
+    class tile_timer /* 作用域计时：析构时记录一个tile的耗时 */
+    {
+    public:
+        tile_timer(int x, int y) : x(x), y(y), start(std::chrono::steady_clock::now()) {}
+        ~tile_timer()
+        {
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            local().tiles.push_back({x, y, ms});
+        }
+
+    private:
+        int x, y;
+        std::chrono::steady_clock::time_point start;
+    };
+
+private:
+    friend struct render_stats_slot;
+    static void absorb(render_stats &counters);
+};
+
+struct render_stats_slot
+{
+    render_stats counters;
+    ~render_stats_slot() { render_stats::absorb(counters); }
+};
+
+inline render_stats &render_stats::local()
+{
+    thread_local render_stats_slot slot;
+    return slot.counters;
+}
+
+#define RT_STAT(counter) (render_stats::local().counter++)
+#define RT_STAT_PATH(length) (render_stats::local().end_path(length))
+#define RT_STAT_TILE(x, y) render_stats::tile_timer rt_stat_tile_timer((x), (y))
+
+#else
+
+#define RT_STAT(counter) ((void)0)
+#define RT_STAT_PATH(length) ((void)0)
+#define RT_STAT_TILE(x, y) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+#include "trace.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+    struct thread_buffer
+    {
+        int tid;
+        std::vector<event> events;
+    };
+
+    static std::mutex registry_mutex;
+    static std::vector<std::shared_ptr<thread_buffer>> registry; /* 线程退出后缓冲区仍保留到输出 */
+    static std::string output;
+    static const auto epoch = std::chrono::steady_clock::now();
+
+    bool active = false;
+
+    long long now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static thread_buffer &local_buffer()
+    {
+        thread_local std::shared_ptr<thread_buffer> buffer;
+        if (!buffer)
+        {
+            buffer = std::make_shared<thread_buffer>();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            buffer->tid = int(registry.size());
+            registry.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void record(const event &e)
+    {
+        local_buffer().events.push_back(e);
+    }
+
+    void start(const std::string &filename)
+    {
+        output = filename;
+        active = !filename.empty();
+    }
+
+    void stop()
+    {
+        // Call only while no other thread is recording, e.g. after the render threads joined.
+        if (!active)
+            return;
+        active = false;
+
+        std::ofstream out(output);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto &buffer : registry)
+        {
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"args\": {\"name\": \"thread " << buffer->tid << "\"}}";
+            first = false;
+            for (const auto &e : buffer->events)
+            {
+                out << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+                    << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us;
+                if (e.x >= 0)
+                    out << ", \"args\": {\"x\": " << e.x << ", \"y\": " << e.y << '}';
+                out << '}';
+            }
+        }
+        out << "\n]}\n";
+    }
+
+    // Starts tracing from RT_TRACE before main() and writes the file after main() returns.
+    static struct auto_trace
+    {
+        auto_trace()
+        {
+            if (auto filename = std::getenv("RT_TRACE"))
+                start(filename);
+        }
+        ~auto_trace() { stop(); }
+    } auto_trace_instance;
+}
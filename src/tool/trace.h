@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <string>
+
+// Timeline tracing in the Chrome trace / Perfetto JSON format. Tracing is off unless the
+// RT_TRACE environment variable names an output file or trace::start() is called; the file is
+// written by trace::stop() or at program exit. Each thread appends to its own buffer, so recording
+// an event never takes a lock; a thread registers its buffer once, on its first event.
+//
+// Open the file in chrome://tracing or https://ui.perfetto.dev.
+
+namespace trace
+{
+    struct event
+    {
+        const char *name; // Must outlive the trace, e.g. a string literal
+        long long start_us;
+        long long duration_us;
+        int x, y; // Optional arguments (tile origin), -1 when unused
+    };
+
+    extern bool active; /* 是否记录事件 */
+
+    void start(const std::string &filename);
+    void stop(); // Writes the file and turns tracing off
+    long long now_us();
+    void record(const event &e);
+
+    class scope /* 作用域事件：构造时开始，析构时记录 */
+    {
+    public:
+        scope(const char *name, int x = -1, int y = -1) : name(name), x(x), y(y), start_us(active ? now_us() : 0) {}
+        ~scope()
+        {
+            if (active)
+                record({name, start_us, now_us() - start_us, x, y});
+        }
+
+    private:
+        const char *name;
+        int x, y;
+        long long start_us;
+    };
+}
+
+#define RT_TRACE_CONCAT2(a, b) a##b
+#define RT_TRACE_CONCAT(a, b) RT_TRACE_CONCAT2(a, b)
+#define RT_TRACE_SCOPE(...) trace::scope RT_TRACE_CONCAT(rt_trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif